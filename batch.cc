@@ -0,0 +1,232 @@
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "src/game.hh"
+#include "src/host.hh"
+#include "src/replay.hh"
+#include "src/thread_pool.hh"
+
+/* Host batch simulator: play every level under a number of input streams
+ * (and replay any keypad recordings given on the command line), each as a
+ * separate job with its own game (see game_state in game.hh), spread over
+ * a work-stealing thread pool (see src/thread_pool.hh). Prints the hash
+ * of the final state of each job (the same as replay -q would for a
+ * recording) and how many ticks per second were simulated altogether.
+ *
+ * The levels are the ones convert put in src/assets.bin, so another level
+ * pack means running convert on it and relinking.
+ *
+ * usage: batch [-j threads] [-n ticks] [-s streams] [recording...] */
+
+/* The two-phase update keeps its intents outside of the games (see
+ * game.hh), so the jobs would get in each other's way */
+#ifdef TWO_PHASE_UPDATE
+#error "batch.cc can't be built with TWO_PHASE_UPDATE"
+#endif
+
+struct job {
+	unsigned int level;
+
+	/* Either random input from this seed for nr_ticks ticks, or the
+	 * whole of a recording */
+	uint32_t seed;
+	const char *filename;
+	const struct recording *recording;
+
+	/* Results */
+	unsigned int nr_ticks;
+	uint64_t hash;
+	uint64_t ns;
+};
+
+/* Random keypad input: Murphy is pushed in a random direction (or not at
+ * all) for a random number of ticks at a time. L and R would change the
+ * level, so those are never pressed. */
+class random_input {
+public:
+	explicit random_input(uint32_t seed):
+		state(seed * 2654435761U + 1),
+		keypad(0),
+		length(0)
+	{
+	}
+
+	uint16_t next()
+	{
+		if (!length) {
+			uint32_t r = rand();
+			unsigned int direction = r % 5;
+
+			keypad = direction < 4 ? 1 << (4 + direction) : 0;
+			length = 1 + (r >> 3) % 32;
+		}
+
+		--length;
+		return keypad;
+	}
+
+private:
+	uint32_t state;
+	uint16_t keypad;
+	unsigned int length;
+
+	/* xorshift32 */
+	uint32_t rand()
+	{
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return state;
+	}
+};
+
+static void run_job(job &j)
+{
+	game_state *g = new game_state();
+	game = g;
+
+	uint64_t start = now();
+	load_level(g->current_level = j.level);
+
+	if (j.recording) {
+		j.nr_ticks = 0;
+
+		for (unsigned int i = 0; i < j.recording->nr_runs; ++i) {
+			const input_run &run = j.recording->runs[i];
+
+			for (unsigned int k = 0; k < run.length; ++k)
+				update(run.keypad);
+
+			j.nr_ticks += run.length;
+		}
+	} else {
+		random_input input(j.seed);
+
+		for (unsigned int i = 0; i < j.nr_ticks; ++i)
+			update(input.next());
+	}
+
+	j.ns = now() - start;
+	j.hash = hash_game();
+
+	game = &default_game;
+	delete g;
+}
+
+static const struct recording *read_recording(const char *filename)
+{
+	FILE *fp = fopen(filename, "rb");
+	if (!fp)
+		throw std::runtime_error(strerror(errno));
+
+	struct recording *r = new struct recording;
+
+	/* SRAM dumps have junk after the last run; that's fine */
+	size_t len = fread(r, 1, sizeof(*r), fp);
+	fclose(fp);
+
+	if (len < 8 || r->magic != RECORDING_MAGIC)
+		throw std::runtime_error("not a recording");
+	if (len < 8 + 4 * (size_t) r->nr_runs)
+		throw std::runtime_error("truncated recording");
+	if (r->level >= nr_levels)
+		throw std::runtime_error("invalid level");
+	if (has_empty_run(*r))
+		throw std::runtime_error("empty run in recording");
+
+	return r;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int nr_threads = std::thread::hardware_concurrency();
+	unsigned int nr_ticks = 1000;
+	unsigned int nr_streams = 4;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "j:n:s:")) != -1) {
+		switch (opt) {
+		case 'j':
+			nr_threads = atoi(optarg);
+			break;
+		case 'n':
+			nr_ticks = atoi(optarg);
+			break;
+		case 's':
+			nr_streams = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-j threads] [-n ticks] [-s streams] [recording...]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+
+	if (nr_threads == 0)
+		nr_threads = 1;
+
+	std::vector<job> jobs;
+
+	for (unsigned int i = 0; i < nr_levels; ++i) {
+		for (unsigned int j = 0; j < nr_streams; ++j) {
+			job k = {};
+			k.level = i;
+			k.seed = j + 1;
+			k.nr_ticks = nr_ticks;
+			jobs.push_back(k);
+		}
+	}
+
+	for (int i = optind; i < argc; ++i) {
+		job k = {};
+		k.filename = argv[i];
+		k.recording = read_recording(argv[i]);
+		k.level = k.recording->level;
+		jobs.push_back(k);
+	}
+
+	init_elements();
+
+	thread_pool pool(nr_threads);
+
+	uint64_t start = now();
+	pool.run(jobs.size(), [&jobs](unsigned int i) {
+		run_job(jobs[i]);
+	});
+	uint64_t ns = now() - start;
+
+	printf("%5s  %5s  %-23s  %8s  %10s  %16s\n", "job", "level", "input",
+		"ticks", "ns/tick", "hash");
+
+	uint64_t total_ticks = 0;
+	for (unsigned int i = 0; i < jobs.size(); ++i) {
+		const job &j = jobs[i];
+
+		char input[24];
+		if (j.recording)
+			snprintf(input, sizeof(input), "%s", j.filename);
+		else
+			snprintf(input, sizeof(input), "random %u", j.seed);
+
+		printf("%5u  %5u  %-23s  %8u  %10.1f  %016llx\n", i + 1,
+			j.level + 1, input, j.nr_ticks,
+			j.nr_ticks ? (double) j.ns / j.nr_ticks : 0.0,
+			(unsigned long long) j.hash);
+
+		total_ticks += j.nr_ticks;
+	}
+
+	printf("%zu jobs, %llu ticks in %.3f s on %u threads: %.0f ticks/sec\n",
+		jobs.size(), (unsigned long long) total_ticks, ns / 1e9,
+		pool.size(), 1e9 * total_ticks / ns);
+
+	return 0;
+}
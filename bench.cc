@@ -0,0 +1,75 @@
+#include <stdexcept>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "src/game.hh"
+#include "src/host.hh"
+#include "src/host_draw.hh"
+
+/* Host build of the game engine: step every level for a fixed number of
+ * ticks (with no keys pressed) and report how fast the field update runs,
+ * and how fast the field can be read out for drawing. Build with
+ * -DFIELD_AOS and/or -DFIELD_PADDED to compare the field layouts (see
+ * game.hh and coordinate.hh). Built with -DPROFILE, it also reports the
+ * time spent in each phase (see src/profile.hh), where a frame is one
+ * update() or one draw_field(). */
+
+int main(int argc, char *argv[])
+{
+	unsigned int nr_ticks = 10000;
+	if (argc > 1)
+		nr_ticks = atoi(argv[1]);
+	if (nr_ticks == 0)
+		throw std::runtime_error("number of ticks must be positive");
+
+	init_elements();
+	profile_init();
+
+	printf("level  %-23s  %12s  %10s  %10s\n", "name", "ticks/sec",
+		"ns/tick", "ns/draw");
+
+	uint64_t total_ns = 0;
+	uint64_t total_draw_ns = 0;
+	unsigned int check = 0;
+
+	for (unsigned int i = 0; i < nr_levels; ++i) {
+		load_level(game->current_level = i);
+
+		uint64_t start = now();
+		for (unsigned int j = 0; j < nr_ticks; ++j)
+			update(0);
+		uint64_t ns = now() - start;
+
+		start = now();
+		for (unsigned int j = 0; j < nr_ticks; ++j) {
+			uint32_t draw_start = profile_clock();
+			check += draw_field();
+			profile_add(PROFILE_DRAW, profile_clock() - draw_start);
+		}
+		uint64_t draw_ns = now() - start;
+
+		total_ns += ns;
+		total_draw_ns += draw_ns;
+		printf("%5u  %-23s  %12.0f  %10.1f  %10.1f\n", i + 1,
+			(const char *) levels[i].name,
+			1e9 * nr_ticks / ns, (double) ns / nr_ticks,
+			(double) draw_ns / nr_ticks);
+	}
+
+	printf("%5s  %-23s  %12.0f  %10.1f  %10.1f\n", "all", "",
+		1e9 * nr_levels * nr_ticks / total_ns,
+		(double) total_ns / (nr_levels * nr_ticks),
+		(double) total_draw_ns / (nr_levels * nr_ticks));
+
+#ifdef PROFILE
+	profile_print(stderr);
+#endif
+
+	/* Never true; keeps draw_field() from being optimised away */
+	if (check == 1)
+		printf("\n");
+
+	return 0;
+}
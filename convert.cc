@@ -1,11 +1,17 @@
+#include <map>
 #include <stdexcept>
+#include <vector>
 
+#include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+
+#include "src/element_type.hh"
 
 static uint8_t get_bit(const uint8_t *data, unsigned int w, unsigned int x, unsigned int y, unsigned int plane)
 {
@@ -20,46 +26,220 @@ static uint8_t get_byte(const uint8_t *data, unsigned int w, unsigned int x, uns
 		| (get_bit(data, w, x, y, 3) << 3);
 }
 
-static void supaplex2gba(const uint8_t *in, unsigned int w, unsigned int x, unsigned int y, uint32_t *out)
+/* An image is the pixels (one per byte) of a square part of one of the
+ * data files, prefixed with its size */
+typedef std::vector<uint8_t> image;
+
+static image get_image(const uint8_t *in, unsigned int w, unsigned int x, unsigned int y, unsigned int size)
 {
-	for (unsigned int v = 0; v < 8; ++v) {
-		out[v] =
-			  (get_byte(in, w, x + 0, y + v) << 0)
-			| (get_byte(in, w, x + 1, y + v) << 4)
-			| (get_byte(in, w, x + 2, y + v) << 8)
-			| (get_byte(in, w, x + 3, y + v) << 12)
-			| (get_byte(in, w, x + 4, y + v) << 16)
-			| (get_byte(in, w, x + 5, y + v) << 20)
-			| (get_byte(in, w, x + 6, y + v) << 24)
-			| (get_byte(in, w, x + 7, y + v) << 28);
+	image result;
+	result.push_back(size);
+
+	for (unsigned int v = 0; v < size; ++v) {
+		for (unsigned int u = 0; u < size; ++u)
+			result.push_back(get_byte(in, w, x + u, y + v));
 	}
+
+	return result;
 }
 
-static void dump_8x8_tile(const uint8_t *in, unsigned int w, unsigned int x, unsigned int y)
+static image flip_image(const image &in, bool flip_x, bool flip_y)
 {
-	uint32_t tile[8];
-	supaplex2gba(in, w, x, y, tile);
+	unsigned int size = in[0];
+	image result(in);
+
+	for (unsigned int v = 0; v < size; ++v) {
+		for (unsigned int u = 0; u < size; ++u) {
+			unsigned int from_u = flip_x ? size - 1 - u : u;
+			unsigned int from_v = flip_y ? size - 1 - v : v;
+
+			result[1 + size * v + u] = in[1 + size * from_v + from_u];
+		}
+	}
+
+	return result;
+}
+
+/* Tiles are collected here and then compressed as a whole. Images that
+ * are already in the bank, also if flipped horizontally and/or
+ * vertically, are only stored once. */
+static struct {
+	/* Every flipped variant of every image in the bank, with the entry
+	 * that add_image() returns for it */
+	std::map<image, uint16_t> images;
 
-	printf("\t");
-	for (unsigned int i = 0; i < 8; ++i)
-		printf("0x%08x, ", tile[i]);
+	/* GBA tile data for the unique images */
+	std::vector<uint8_t> data;
 
-	printf("\n");
+	unsigned int nr_images;
+	unsigned int nr_unique_images;
+} tile_bank;
+
+/* Entries returned by add_image(), in the order that the images were
+ * added */
+static std::vector<uint16_t> tile_map;
+
+static void clear_tile_bank()
+{
+	tile_bank.images.clear();
+	tile_bank.data.clear();
+	tile_bank.nr_images = 0;
+	tile_bank.nr_unique_images = 0;
+	tile_map.clear();
+}
+
+/* Return the tile number of the image in the bank along with the flip
+ * bits needed to display it, in the same format as a BG map entry (the
+ * OBJ flip bits go elsewhere, but the game takes care of that). 16x16
+ * images are stored as four consecutive tiles in the order in which
+ * 16x16 sprites use them. */
+static uint16_t add_image(const image &in)
+{
+	++tile_bank.nr_images;
+
+	std::map<image, uint16_t>::const_iterator it = tile_bank.images.find(in);
+	if (it != tile_bank.images.end())
+		return it->second;
+
+	uint16_t tile = tile_bank.data.size() / 32;
+	for (unsigned int flip = 0; flip < 4; ++flip) {
+		tile_bank.images.insert(std::make_pair(
+			flip_image(in, flip & 1, flip & 2), tile | (flip << 10)));
+	}
+
+	unsigned int size = in[0];
+	for (unsigned int y = 0; y < size; y += 8) {
+		for (unsigned int x = 0; x < size; x += 8) {
+			for (unsigned int v = 0; v < 8; ++v) {
+				uint32_t row = 0;
+				for (unsigned int u = 0; u < 8; ++u)
+					row |= in[1 + size * (y + v) + x + u] << (4 * u);
+
+				for (unsigned int i = 0; i < 4; ++i)
+					tile_bank.data.push_back(row >> (8 * i));
+			}
+		}
+	}
+
+	++tile_bank.nr_unique_images;
+	return tile;
+}
+
+static void dump_8x8_tile(const uint8_t *in, unsigned int w, unsigned int x, unsigned int y)
+{
+	tile_map.push_back(add_image(get_image(in, w, x, y, 8)));
 }
 
 static void dump_16x16_tile(const uint8_t *in, unsigned int w, unsigned int x, unsigned int y)
 {
-	/* This corresponds to the order in which 16x16 sprites use the
-	 * tiles. */
-	dump_8x8_tile(in, w, x + 0, y + 0);
-	dump_8x8_tile(in, w, x + 8, y + 0);
-	dump_8x8_tile(in, w, x + 0, y + 8);
-	dump_8x8_tile(in, w, x + 8, y + 8);
+	tile_map.push_back(add_image(get_image(in, w, x, y, 16)));
 }
 
-static void dump_palette(const uint8_t *in)
+/* Compress data in the format understood by the GBA BIOS LZ77
+ * decompression functions (SWI 0x11 and 0x12). We never emit a
+ * back-reference with a displacement of 1, since SWI 0x12 (which writes
+ * 16 bits at a time, as needed for VRAM) can't handle them. */
+static std::vector<uint8_t> lz77_compress(const std::vector<uint8_t> &in)
+{
+	std::vector<uint8_t> out;
+
+	out.push_back(0x10);
+	out.push_back(in.size() >> 0);
+	out.push_back(in.size() >> 8);
+	out.push_back(in.size() >> 16);
+
+	unsigned int i = 0;
+	while (i < in.size()) {
+		unsigned int flags_index = out.size();
+		out.push_back(0);
+
+		for (unsigned int block = 0; block < 8 && i < in.size(); ++block) {
+			/* Find the longest match in the window */
+			unsigned int best_len = 0;
+			unsigned int best_disp = 0;
+
+			for (unsigned int disp = 2; disp <= 4096 && disp <= i; ++disp) {
+				unsigned int len = 0;
+				while (len < 18 && i + len < in.size() && in[i + len] == in[i + len - disp])
+					++len;
+
+				if (len > best_len) {
+					best_len = len;
+					best_disp = disp;
+				}
+			}
+
+			if (best_len >= 3) {
+				out[flags_index] |= 0x80 >> block;
+				out.push_back(((best_len - 3) << 4) | ((best_disp - 1) >> 8));
+				out.push_back((best_disp - 1) & 0xff);
+				i += best_len;
+			} else {
+				out.push_back(in[i]);
+				++i;
+			}
+		}
+	}
+
+	while (out.size() % 4)
+		out.push_back(0);
+
+	return out;
+}
+
+/* All the converted data ends up in a single binary blob which is linked
+ * into the program as is. The generated src/assets.s gives each part of
+ * it a symbol (and one for its size), and the generated header declares
+ * them, so the offsets and sizes are only known at link time. */
+struct asset {
+	const char *name;
+	const char *type; /* Of its elements, in the generated header */
+	unsigned int offset;
+	unsigned int size;
+};
+
+static std::vector<uint8_t> asset_data;
+static std::vector<asset> asset_table;
+
+/* Number of levels in LEVELS.DAT */
+static const unsigned int nr_levels = 111;
+
+static void add_asset(const char *name, const char *type,
+	const std::vector<uint8_t> &data)
+{
+	/* Keep everything word aligned so that it can be DMA'd and passed
+	 * to the BIOS decompression functions directly. */
+	while (asset_data.size() % 4)
+		asset_data.push_back(0);
+
+	asset a = { name, type, (unsigned int) asset_data.size(), (unsigned int) data.size() };
+	asset_table.push_back(a);
+	asset_data.insert(asset_data.end(), data.begin(), data.end());
+}
+
+static void add_entries(const char *name, const std::vector<uint16_t> &entries)
+{
+	std::vector<uint8_t> data;
+	for (unsigned int i = 0; i < entries.size(); ++i) {
+		data.push_back(entries[i] >> 0);
+		data.push_back(entries[i] >> 8);
+	}
+
+	add_asset(name, "uint16_t", data);
+}
+
+static void add_lz77(const char *name, const std::vector<uint8_t> &data)
+{
+	std::vector<uint8_t> compressed = lz77_compress(data);
+
+	fprintf(stderr, "%s: %u bytes, %u bytes compressed\n", name,
+		(unsigned int) data.size(), (unsigned int) compressed.size());
+
+	add_asset(name, "uint32_t", compressed);
+}
+
+static void dump_palette(std::vector<uint8_t> &out, const uint8_t *in)
 {
-	printf("\t");
 	for (unsigned int i = 0; i < 16; ++i) {
 		uint8_t r = in[4 * i + 0];
 		uint8_t g = in[4 * i + 1];
@@ -70,10 +250,9 @@ static void dump_palette(const uint8_t *in)
 			| ((g * 31 / 15) << 5)
 			| ((b * 31 / 15) << 10);
 
-		printf("0x%04x, ", colour);
+		out.push_back(colour >> 0);
+		out.push_back(colour >> 8);
 	}
-
-	printf("\n");
 }
 
 static void convert_palette()
@@ -91,12 +270,12 @@ static void convert_palette()
 	if (len != sizeof(data))
 		throw std::runtime_error("wrong number of bytes read");
 
-	printf("static const uint16_t palettes[] = {\n");
-	dump_palette(data + 64);
-	dump_palette(data + 0);
-	dump_palette(data + 128);
-	dump_palette(data + 192);
-	printf("};\n");
+	std::vector<uint8_t> palettes;
+	dump_palette(palettes, data + 64);
+	dump_palette(palettes, data + 0);
+	dump_palette(palettes, data + 128);
+	dump_palette(palettes, data + 192);
+	add_asset("palettes", "uint16_t", palettes);
 
 	close(fd);
 }
@@ -131,23 +310,25 @@ static void convert_fixed()
 	}
 #endif
 
-	printf("static const uint32_t fixed[] = {\n");
-
-	/* The order/numbering of these tiles correpond to "enum tile" */
-	for (unsigned int i = 0; i < 11; ++i)
-		dump_16x16_tile(data, 640, 16 * i, 0);
+	clear_tile_bank();
 
-	/* Skip ports which we can create by mirroring */
+	/* The order/numbering of these tiles corresponds to the first 40
+	 * elements of "enum element_type". Tiles that are mirror images of
+	 * each other (e.g. the ports) are only stored once. They are kept
+	 * whole rather than split up into 8x8 tiles, so that the game only
+	 * needs the one entry per tile (see draw_tile() in supaplex.cc). */
+	for (unsigned int i = 0; i < 40; ++i) {
+		/* The bug looks just like a base */
+		unsigned int x = 16 * (i == 25 ? 2 : i);
 
-	for (unsigned int i = 17; i < 25; ++i)
-		dump_16x16_tile(data, 640, 16 * i, 0);
-
-	/* Skip bug (we can reuse the base) */
+		dump_16x16_tile(data, 640, x, 0);
+	}
 
-	for (unsigned int i = 26; i < 40; ++i)
-		dump_16x16_tile(data, 640, 16 * i, 0);
+	fprintf(stderr, "fixed: %u tiles, %u unique\n",
+		tile_bank.nr_images, tile_bank.nr_unique_images);
 
-	printf("};\n");
+	add_lz77("fixed", tile_bank.data);
+	add_entries("fixed_map", tile_map);
 
 	close(fd);
 }
@@ -195,7 +376,10 @@ static void convert_moving()
 	}
 #endif
 
-	printf("static const uint32_t moving[] = {\n");
+	/* Each 16x16 tile is a sprite frame (except for the 8x8 cursor
+	 * sparks at the end); frames that are mirror images of each other
+	 * share their tiles. */
+	clear_tile_bank();
 
 	/* Murphy moving left (sprites) */
 	dump_16x16_tile(moving_data, 320,  1 * 16 -  2, 0 * 16);
@@ -310,37 +494,167 @@ static void convert_moving()
 	}
 #endif
 
-	printf("};\n");
+	fprintf(stderr, "moving: %u frames, %u unique\n",
+		tile_bank.nr_images, tile_bank.nr_unique_images);
+
+	add_lz77("moving", tile_bank.data);
+	add_entries("moving_frames", tile_map);
 
 	close(moving_fd);
 	close(fixed_fd);
 }
 
-static void convert_level(const uint8_t *level)
+/* Run-length encode a game field. Each run is a byte with the element
+ * code in the lower 6 bits and the run length minus 1 in the upper 2
+ * bits; if those are all set, the run length minus 4 (up to 255) is in
+ * the next byte instead. Runs may continue from one row to the next.
+ * This is decoded by load_level() in game.hh. */
+static void encode_field(std::vector<uint8_t> &out, const uint8_t *field)
 {
-	printf("\t{\n");
+	unsigned int i = 0;
+	while (i < 60 * 24) {
+		uint8_t code = field[i];
+		if (code >= 0x40)
+			throw std::runtime_error("element code out of range");
+
+		unsigned int len = 1;
+		while (len < 259 && i + len < 60 * 24 && field[i + len] == code)
+			++len;
+
+		if (len < 4) {
+			out.push_back(code | ((len - 1) << 6));
+		} else {
+			out.push_back(code | (3 << 6));
+			out.push_back(len - 4);
+		}
 
-	printf("\t\t{\n");
-	for (unsigned int y = 0; y < 24; ++y) {
-		printf("\t\t\t{ ");
+		i += len;
+	}
+}
+
+/* Elements that may need to be updated as soon as the level starts. This
+ * must include every static element that init_elements() in game.hh
+ * gives an update function, since load_level() only looks at these. */
+static bool is_object(uint8_t code)
+{
+	switch (code) {
+	case ELEMENT_ZONK:
+	case ELEMENT_INFOTRON:
+	case ELEMENT_DISK_ORANGE:
+	case ELEMENT_SNIK_SNAK:
+	case ELEMENT_DISK_YELLOW:
+	case ELEMENT_TERMINAL:
+	case ELEMENT_DISK_RED:
+	case ELEMENT_ELECTRON:
+	case ELEMENT_BUG:
+		return true;
+	}
 
-		for (unsigned int x = 0; x < 60; ++x)
-			printf("0x%02x, ", level[60 * y + x]);
+	return false;
+}
+
+static void put16(std::vector<uint8_t> &out, uint16_t x)
+{
+	out.push_back(x >> 0);
+	out.push_back(x >> 8);
+}
 
-		printf(" },\n");
+static void put32(std::vector<uint8_t> &out, uint32_t x)
+{
+	put16(out, x >> 0);
+	put16(out, x >> 16);
+}
+
+/* The layout of this must match "struct level" in the generated header.
+ * Each level in LEVELS.DAT is the 60x24 game field followed by:
+ *
+ *   0: unused (4 bytes)
+ *   4: gravity (1 = on)
+ *   5: SpeedFix version
+ *   6: name (23 bytes)
+ *  29: freeze zonks (2 = on)
+ *  30: number of infotrons needed (0 = all of them)
+ *  31: number of special ports (at most 10)
+ *  32: special ports (10 x 6 bytes): position (big endian, 2 * (x + 60 * y)),
+ *      gravity, freeze zonks, freeze enemies, unused
+ *  92: SpeedFix/demo data (4 bytes)
+ */
+static void convert_level(std::vector<uint8_t> &out, std::vector<uint8_t> &fields,
+	std::vector<uint16_t> &objects, const uint8_t *level)
+{
+	const uint8_t *info = level + 60 * 24;
+
+	uint8_t field[60 * 24];
+	memcpy(field, level, sizeof(field));
+
+	/* Murphy isn't part of the game field as far as the game is
+	 * concerned; he starts out on top of the first Murphy and any
+	 * others are just obstacles. */
+	unsigned int murphy;
+	for (murphy = 0; murphy < 60 * 24; ++murphy) {
+		if (field[murphy] == ELEMENT_MURPHY)
+			break;
 	}
 
-	printf("\t\t},\n");
+	if (murphy == 60 * 24)
+		throw std::runtime_error("level without murphy");
 
-	/* Name */
-	printf("\t\t{ ");
-	for (unsigned int i = 0; i < 23; ++i)
-		printf("0x%02x, ", level[1440 + 4 + 1 + 1 + i]);
-	printf(" 0x00 },\n");
+	field[murphy] = ELEMENT_SPACE;
+
+	unsigned int nr_infotrons = 0;
+	unsigned int first_object = objects.size();
+
+	for (unsigned int i = 0; i < 60 * 24; ++i) {
+		if (field[i] == ELEMENT_INFOTRON)
+			++nr_infotrons;
+		if (is_object(field[i]))
+			objects.push_back(i);
+	}
+
+	/* A level can have more than 255 infotrons, so this is 16 bits in
+	 * struct level even though the trailer only has a byte for it */
+	if (info[30])
+		nr_infotrons = info[30];
+
+	if (info[31] > 10)
+		throw std::runtime_error("too many special ports");
+
+	put32(out, fields.size());
+	encode_field(fields, field);
 
-	/* XXX: Other properties */
+	put32(out, first_object);
+	put16(out, objects.size() - first_object);
 
-	printf("\t},\n");
+	out.push_back(murphy % 60);
+	out.push_back(murphy / 60);
+
+	/* Name */
+	out.insert(out.end(), info + 6, info + 6 + 23);
+	out.push_back(0);
+
+	out.push_back(info[4] == 1);
+	out.push_back(info[29] == 2);
+	put16(out, nr_infotrons);
+	out.push_back(info[31]);
+
+	/* Padding, so that the special ports are aligned */
+	for (unsigned int i = 0; i < 3; ++i)
+		out.push_back(0);
+
+	for (unsigned int i = 0; i < 10; ++i) {
+		const uint8_t *port = info + 32 + 6 * i;
+
+		if (i < info[31]) {
+			put16(out, ((port[0] << 8) | port[1]) / 2);
+			out.push_back(port[2] == 1);
+			out.push_back(port[3] == 2);
+			out.push_back(port[4] == 2);
+			out.push_back(0);
+		} else {
+			for (unsigned int j = 0; j < 6; ++j)
+				out.push_back(0);
+		}
+	}
 }
 
 static void convert_levels()
@@ -349,7 +663,7 @@ static void convert_levels()
 	if (fd == -1)
 		throw std::runtime_error(strerror(errno));
 
-	uint8_t data[170496];
+	uint8_t data[1536 * nr_levels];
 	int len = read(fd, data, sizeof(data));
 	if (len == -1)
 		throw std::runtime_error(strerror(errno));
@@ -358,26 +672,151 @@ static void convert_levels()
 	if (len != sizeof(data))
 		throw std::runtime_error("wrong number of bytes read");
 
-	printf("static struct {\n");
-	printf("\tuint8_t field[24][60];\n");
-	printf("\tuint8_t name[24];\n");
-	printf("\tuint8_t nr_infotrons;\n");
-	printf("} levels[] = {\n");
+	std::vector<uint8_t> levels;
+	std::vector<uint8_t> fields;
+	std::vector<uint16_t> objects;
+	for (unsigned int i = 0; i < nr_levels; ++i)
+		convert_level(levels, fields, objects, data + 1536 * i);
 
-	for (unsigned int i = 0; i < 111; ++i)
-		convert_level(data + 1536 * i);
+	fprintf(stderr, "level fields: %u bytes, %u bytes compressed\n",
+		nr_levels * 60 * 24, (unsigned int) fields.size());
 
-	printf("};\n");
+	add_asset("levels", "struct level", levels);
+	add_asset("level_fields", "uint8_t", fields);
+	add_entries("level_objects", objects);
 
 	close(fd);
 }
 
+static void write_data(const char *filename)
+{
+	FILE *fp = fopen(filename, "wb");
+	if (!fp)
+		throw std::runtime_error(strerror(errno));
+
+	if (fwrite(&asset_data[0], 1, asset_data.size(), fp) != asset_data.size())
+		throw std::runtime_error(strerror(errno));
+
+	if (fclose(fp) == EOF)
+		throw std::runtime_error(strerror(errno));
+}
+
+static void write_header(const char *filename)
+{
+	FILE *fp = fopen(filename, "w");
+	if (!fp)
+		throw std::runtime_error(strerror(errno));
+
+	fprintf(fp, "/* Generated by convert -- do not edit. Only the format of the data\n");
+	fprintf(fp, " * is in here, so this only changes along with convert. */\n\n");
+	fprintf(fp, "#ifndef ASSETS_HH\n");
+	fprintf(fp, "#define ASSETS_HH\n\n");
+	fprintf(fp, "#include <stdint.h>\n\n");
+
+	fprintf(fp, "struct special_port {\n");
+	fprintf(fp, "\tuint16_t position;\n");
+	fprintf(fp, "\tuint8_t gravity;\n");
+	fprintf(fp, "\tuint8_t freeze_zonks;\n");
+	fprintf(fp, "\tuint8_t freeze_enemies;\n");
+	fprintf(fp, "\tuint8_t unused;\n");
+	fprintf(fp, "};\n\n");
+
+	fprintf(fp, "struct level {\n");
+	fprintf(fp, "\tuint32_t field; /* Offset into level_fields */\n");
+	fprintf(fp, "\tuint32_t objects; /* Index into level_objects */\n");
+	fprintf(fp, "\tuint16_t nr_objects;\n");
+	fprintf(fp, "\tuint8_t murphy_x;\n");
+	fprintf(fp, "\tuint8_t murphy_y;\n");
+	fprintf(fp, "\tuint8_t name[24];\n");
+	fprintf(fp, "\tuint8_t gravity;\n");
+	fprintf(fp, "\tuint8_t freeze_zonks;\n");
+	fprintf(fp, "\tuint16_t nr_infotrons; /* Number of infotrons needed */\n");
+	fprintf(fp, "\tuint8_t nr_special_ports;\n");
+	fprintf(fp, "\tuint8_t unused[3];\n");
+	fprintf(fp, "\tstruct special_port special_ports[10];\n");
+	fprintf(fp, "};\n\n");
+
+	fprintf(fp, "/* Defined in assets.s. The size of each part of the data is in\n");
+	fprintf(fp, " * bytes. */\n");
+	fprintf(fp, "extern \"C\" {\n");
+	fprintf(fp, "extern const uint32_t nr_levels;\n\n");
+
+	for (unsigned int i = 0; i < asset_table.size(); ++i) {
+		const asset &a = asset_table[i];
+
+		fprintf(fp, "extern const %s %s[];\n", a.type, a.name);
+		fprintf(fp, "extern const uint32_t %s_size;\n", a.name);
+	}
+
+	fprintf(fp, "}\n\n");
+
+	fprintf(fp, "#endif\n");
+
+	if (fclose(fp) == EOF)
+		throw std::runtime_error(strerror(errno));
+}
+
+/* The assembler finds the data through its -I (see make.sh), so only the
+ * base name of data_filename goes in here */
+static void write_assembly(const char *filename, const char *data_filename)
+{
+	FILE *fp = fopen(filename, "w");
+	if (!fp)
+		throw std::runtime_error(strerror(errno));
+
+	const char *data_name = strrchr(data_filename, '/');
+	data_name = data_name ? data_name + 1 : data_filename;
+
+	fprintf(fp, "/* Generated by convert -- do not edit. This is assembled for both the\n");
+	fprintf(fp, " * GBA and the host, so only use directives that both understand. */\n\n");
+	fprintf(fp, "\t.section .rodata\n");
+	fprintf(fp, "\t.balign 4\n\n");
+
+	fprintf(fp, "\t.global nr_levels\n");
+	fprintf(fp, "nr_levels:\n");
+	fprintf(fp, "\t.4byte %u\n", nr_levels);
+
+	for (unsigned int i = 0; i < asset_table.size(); ++i) {
+		const asset &a = asset_table[i];
+
+		fprintf(fp, "\n\t.global %s_size\n", a.name);
+		fprintf(fp, "%s_size:\n", a.name);
+		fprintf(fp, "\t.4byte 0x%06x\n", a.size);
+	}
+
+	for (unsigned int i = 0; i < asset_table.size(); ++i) {
+		const asset &a = asset_table[i];
+
+		fprintf(fp, "\n\t.balign 4\n");
+		fprintf(fp, "\t.global %s\n", a.name);
+		fprintf(fp, "%s:\n", a.name);
+		fprintf(fp, "\t.incbin \"%s\", 0x%06x, 0x%06x\n", data_name,
+			a.offset, a.size);
+	}
+
+	fprintf(fp, "\n\t/* We don't need an executable stack (this only matters on the\n");
+	fprintf(fp, "\t * host) */\n");
+	fprintf(fp, "\t.section .note.GNU-stack,\"\",%%progbits\n");
+
+	if (fclose(fp) == EOF)
+		throw std::runtime_error(strerror(errno));
+}
+
 int main(int argc, char *argv[])
 {
+	if (argc != 4) {
+		fprintf(stderr, "usage: %s <assets.bin> <assets.hh> <assets.s>\n", argv[0]);
+		return 1;
+	}
+
 	convert_palette();
 	convert_fixed();
 	convert_moving();
 	convert_levels();
 
+	write_data(argv[1]);
+	write_header(argv[2]);
+	write_assembly(argv[3], argv[1]);
+
 	return 0;
 }
@@ -36,15 +36,52 @@ hostcxxflags="-Wall -g"
 
 ${hostcxx} ${hostcxxflags} -o convert convert.cc
 
-./convert > src/graphics.cc
-
-
-# Compile target programs
+# The data is linked in as a binary blob by the generated src/assets.s,
+# which finds it through the -I given to the assembler. Where everything
+# is in it is only known at link time, so changing the data doesn't mean
+# compiling anything but src/assets.s.
+./convert src/assets.bin src/assets.hh src/assets.s
+
+# Host build of the game engine (no graphics) for benchmarking
+${hostcxx} ${hostcxxflags} -std=c++0x -O3 -Wa,-I,src -o bench bench.cc src/assets.s
+${hostcxx} ${hostcxxflags} -std=c++0x -O3 -Wa,-I,src -DFIELD_AOS -o bench-aos bench.cc src/assets.s
+${hostcxx} ${hostcxxflags} -std=c++0x -O3 -Wa,-I,src -DFIELD_PADDED -o bench-padded bench.cc src/assets.s
+${hostcxx} ${hostcxxflags} -std=c++0x -O3 -Wa,-I,src -DELEMENT_SWITCH -o bench-switch bench.cc src/assets.s
+${hostcxx} ${hostcxxflags} -std=c++0x -O3 -Wa,-I,src -DTWO_PHASE_UPDATE -o bench-two-phase bench.cc src/assets.s
+
+# Host scaling benchmark of a big field updated by a thread pool (see
+# src/strips.hh)
+${hostcxx} ${hostcxxflags} -std=c++0x -O3 -Wa,-I,src -DFIELD_WIDTH=2048 -DFIELD_HEIGHT=2048 -pthread -o scale scale.cc src/assets.s
+
+# Host batch simulator: every level under many input streams, spread over
+# a thread pool (see src/thread_pool.hh)
+${hostcxx} ${hostcxxflags} -std=c++0x -O3 -Wa,-I,src -pthread -o batch batch.cc src/assets.s
+
+# Host micro-benchmark of the element predicates (see src/element.hh)
+${hostcxx} ${hostcxxflags} -std=c++0x -O3 -Wa,-I,src -o predbench predbench.cc src/assets.s
+
+# Host replay runner for keypad recordings (see src/replay.hh)
+${hostcxx} ${hostcxxflags} -std=c++0x -O3 -Wa,-I,src -o replay replay.cc src/assets.s
+${hostcxx} ${hostcxxflags} -std=c++0x -O3 -Wa,-I,src -DPROFILE -o replay-profile replay.cc src/assets.s
+
+
+# Compile target programs. Everything is Thumb code in GamePak ROM except
+# for the functions marked __iwram (see src/section.hh), which are ARM
+# code in IWRAM. Add -DPROFILE to cxxflags for the profiling overlay (see
+# src/profile.hh), and -DELEMENT_SWITCH to dispatch the element update
+# functions with a switch rather than function pointers (see
+# update_element() in src/game.hh).
 
 cxx=arm-eabi-g++
-cxxflags="-std=c++0x -g -Wall -O3 -mcpu=arm7tdmi -mtune=arm7tdmi -fomit-frame-pointer -ffast-math -marm -specs=gba.specs"
+cxxflags="-std=c++0x -g -Wall -O3 -mcpu=arm7tdmi -mtune=arm7tdmi -fomit-frame-pointer -ffast-math -mthumb -mthumb-interwork -fno-exceptions -fno-rtti"
+ldflags="-nostartfiles -T src/gba.ld -Wa,-I,src"
+
+${cxx} ${cxxflags} ${ldflags} -o supaplex.elf src/crt0.s src/assets.s src/supaplex.cc
 
-${cxx} ${cxxflags} -o supaplex.elf src/supaplex.cc
+# Report what ended up where
+arm-eabi-size -A -x supaplex.elf
+echo "IWRAM:"
+arm-eabi-nm -C -S --size-sort supaplex.elf | awk '$1 ~ /^03/'
 
 arm-eabi-objcopy -O binary -S supaplex.elf supaplex.bin
 ln -sf supaplex.bin supaplex.gba
@@ -0,0 +1,120 @@
+#include <stdexcept>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "src/assets.hh"
+#include "src/element.hh"
+#include "src/host.hh"
+#include "src/level.hh"
+
+/* Host micro-benchmark of the element predicates: evaluate is_round(),
+ * is_edible() and is_explodable() over the element codes of every level
+ * (the mix the game actually sees), once with the trait table and once with
+ * the chains of comparisons it replaced. */
+
+namespace compare {
+
+static bool is_round(const element &e)
+{
+	return e.code == ELEMENT_CHIP_SQUARE
+		|| e.code == ELEMENT_CHIP_VERTICAL_TOP
+		|| e.code == ELEMENT_CHIP_HORIZONTAL_LEFT
+		|| e.code == ELEMENT_CHIP_HORIZONTAL_RIGHT
+		|| e.code == ELEMENT_ZONK
+		|| e.code == ELEMENT_INFOTRON;
+}
+
+static bool is_edible(const element &e)
+{
+	return e.code == ELEMENT_SPACE
+		|| e.code == ELEMENT_BASE
+		|| e.code == ELEMENT_INFOTRON
+		|| e.code == ELEMENT_DISK_RED
+		|| e.code == ELEMENT_BUG;
+}
+
+static bool is_explodable(const element &e)
+{
+	return e.code != ELEMENT_WALL
+		&& e.code != ELEMENT_WALL_INVISIBLE
+		&& (e.code < ELEMENT_HARDWARE_1 || e.code > ELEMENT_HARDWARE_7);
+}
+
+}
+
+/* Keep the compiler from hoisting the predicates out of the loop */
+static element *volatile cells_ptr;
+
+template<typename round_fn, typename edible_fn, typename explodable_fn>
+static unsigned int run(const char *name, unsigned int nr_cells,
+	unsigned int nr_passes,
+	round_fn round, edible_fn edible, explodable_fn explodable)
+{
+	unsigned int count = 0;
+
+	uint64_t start = now();
+	for (unsigned int i = 0; i < nr_passes; ++i) {
+		const element *cells = cells_ptr;
+		for (unsigned int j = 0; j < nr_cells; ++j) {
+			count += round(cells[j]);
+			count += edible(cells[j]);
+			count += explodable(cells[j]);
+		}
+	}
+	uint64_t ns = now() - start;
+
+	double nr_calls = 3.0 * nr_cells * nr_passes;
+	printf("%-12s  %12.0f  %10.3f\n", name,
+		1e9 * nr_calls / ns, ns / nr_calls);
+	return count;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int nr_passes = 100;
+	if (argc > 1)
+		nr_passes = atoi(argv[1]);
+	if (nr_passes == 0)
+		throw std::runtime_error("number of passes must be positive");
+
+	/* Every cell of every level, plus one of each element code so that
+	 * the dynamic states are checked too */
+	unsigned int nr_cells = 0;
+	element *cells = new element[nr_levels * 1440 + NR_ELEMENTS];
+	for (unsigned int i = 0; i < nr_levels; ++i) {
+		decode_level(levels[i], [&](unsigned int, unsigned int, element_type code) {
+			cells[nr_cells++].code = code;
+		});
+	}
+
+	for (unsigned int i = 0; i < NR_ELEMENTS; ++i)
+		cells[nr_cells++].code = (element_type) i;
+
+	for (unsigned int i = 0; i < nr_cells; ++i) {
+		const element &e = cells[i];
+		if (e.is_round() != compare::is_round(e)
+			|| e.is_edible() != compare::is_edible(e)
+			|| e.is_explodable() != compare::is_explodable(e))
+		{
+			fprintf(stderr, "trait table disagrees for element %u\n",
+				e.code);
+			return 1;
+		}
+	}
+
+	cells_ptr = cells;
+
+	printf("%-12s  %12s  %10s\n", "predicates", "calls/sec", "ns/call");
+
+	unsigned int a = run("comparisons", nr_cells, nr_passes,
+		compare::is_round, compare::is_edible, compare::is_explodable);
+	unsigned int b = run("table", nr_cells, nr_passes,
+		[](const element &e) { return e.is_round(); },
+		[](const element &e) { return e.is_edible(); },
+		[](const element &e) { return e.is_explodable(); });
+
+	delete[] cells;
+	return a != b;
+}
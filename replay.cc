@@ -0,0 +1,94 @@
+#include <stdexcept>
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "src/game.hh"
+#include "src/host.hh"
+#include "src/host_draw.hh"
+#include "src/replay.hh"
+
+/* Host replay runner: feed a keypad recording (e.g. an SRAM dump from the
+ * GBA) to the game engine and print a hash of the game state after every
+ * tick. Two builds of the engine behave the same if they print the same
+ * hashes. With -q, only the final hash is printed, along with how long
+ * the replay took. Built with -DPROFILE, it also draws the field after
+ * every tick (see src/host_draw.hh) and reports the time spent in each
+ * phase (see src/profile.hh). */
+
+int main(int argc, char *argv[])
+{
+	bool quiet = argc == 3 && !strcmp(argv[1], "-q");
+	if (argc != 2 && !quiet) {
+		fprintf(stderr, "usage: %s [-q] <recording>\n", argv[0]);
+		return 1;
+	}
+
+	FILE *fp = fopen(argv[argc - 1], "rb");
+	if (!fp)
+		throw std::runtime_error(strerror(errno));
+
+	/* SRAM dumps have junk after the last run; that's fine */
+	size_t len = fread(&recording, 1, sizeof(recording), fp);
+	fclose(fp);
+
+	if (len < 8 || len < 8 + 4 * (size_t) recording.nr_runs)
+		throw std::runtime_error("truncated recording");
+
+	init_elements();
+
+	if (recording.magic != RECORDING_MAGIC)
+		throw std::runtime_error("not a recording");
+	if (recording.level >= nr_levels)
+		throw std::runtime_error("invalid level");
+	if (has_empty_run(recording))
+		throw std::runtime_error("empty run in recording");
+
+	start_replay();
+
+	load_level(game->current_level = recording.level);
+
+	unsigned int nr_ticks = 0;
+	uint64_t start = now();
+
+	profile_init();
+
+	unsigned int check = 0;
+
+	while (!replay_done()) {
+		uint32_t tick_start = profile_clock();
+		update(input(0));
+
+#ifdef PROFILE
+		uint32_t draw_start = profile_clock();
+		check += draw_field();
+		profile_add(PROFILE_DRAW, profile_clock() - draw_start);
+#endif
+
+		profile_add(PROFILE_FRAME, profile_clock() - tick_start);
+		++nr_ticks;
+
+		if (!quiet)
+			printf("%u %016llx\n", nr_ticks, (unsigned long long) hash_game());
+	}
+
+	uint64_t ns = now() - start;
+
+	if (quiet) {
+		printf("%u %016llx\n", nr_ticks, (unsigned long long) hash_game());
+		fprintf(stderr, "%u ticks in %.3f ms (%.1f ns/tick)\n",
+			nr_ticks, ns / 1e6, (double) ns / nr_ticks);
+	}
+
+#ifdef PROFILE
+	profile_print(stderr);
+#endif
+
+	/* Never true; keeps draw_field() from being optimised away */
+	if (check == 1)
+		printf("\n");
+
+	return 0;
+}
@@ -0,0 +1,93 @@
+#include <stdexcept>
+#include <thread>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "src/game.hh"
+#include "src/host.hh"
+#include "src/strips.hh"
+
+/* Host scaling benchmark of update_field_strips() (see src/strips.hh):
+ * load a level onto a big field (built with e.g. -DFIELD_WIDTH=2048
+ * -DFIELD_HEIGHT=2048, see src/coordinate.hh) and step it for a fixed
+ * number of ticks with 1, 2, ... threads, reporting how fast the field
+ * update runs, how that compares with one thread, and how much of the
+ * time the threads spent waiting for each other rather than updating.
+ * The field must end up the same however many threads there are, and
+ * the same as with the plain update(), so this also prints a hash of the
+ * game (see hash_game() in src/game.hh) and fails if they differ. */
+
+int main(int argc, char *argv[])
+{
+	unsigned int nr_ticks = 100;
+	if (argc > 1)
+		nr_ticks = atoi(argv[1]);
+	if (nr_ticks == 0)
+		throw std::runtime_error("number of ticks must be positive");
+
+	unsigned int max_threads = std::thread::hardware_concurrency();
+	if (argc > 2)
+		max_threads = atoi(argv[2]);
+	if (max_threads == 0)
+		max_threads = 1;
+
+	unsigned int level = 0;
+	if (argc > 3)
+		level = atoi(argv[3]) - 1;
+	if (level >= nr_levels)
+		throw std::runtime_error("no such level");
+
+	init_elements();
+
+	printf("%ux%u field, level %u, %u ticks\n", field_width, field_height,
+		level + 1, nr_ticks);
+	printf("%7s  %6s  %12s  %10s  %7s  %7s  %16s\n", "threads", "strips",
+		"ticks/sec", "ms/tick", "speedup", "waiting", "hash");
+
+	load_level(level);
+	uint64_t start = now();
+	for (unsigned int i = 0; i < nr_ticks; ++i)
+		update(0);
+	uint64_t ns = now() - start;
+
+	uint64_t expected = hash_game();
+	printf("%7s  %6s  %12.1f  %10.3f  %7s  %7s  %016llx\n", "-", "-",
+		1e9 * nr_ticks / ns, ns / 1e6 / nr_ticks, "", "",
+		(unsigned long long) expected);
+
+	uint64_t one_thread_ns = 0;
+	bool ok = true;
+
+	for (unsigned int nr_threads = 1; nr_threads <= max_threads; ++nr_threads) {
+		thread_pool pool(nr_threads);
+		split_field(nr_threads);
+
+		load_level(level);
+		start = now();
+		for (unsigned int i = 0; i < nr_ticks; ++i) {
+			/* update(0), with the field updated in strips */
+			update_field_strips(pool);
+			update_murphy();
+			update_keypad(0);
+		}
+		ns = now() - start;
+
+		if (nr_threads == 1)
+			one_thread_ns = ns;
+
+		uint64_t hash = hash_game();
+		printf("%7u  %6u  %12.1f  %10.3f  %7.2f  %6.1f%%  %016llx%s\n",
+			nr_threads, nr_strips, 1e9 * nr_ticks / ns,
+			ns / 1e6 / nr_ticks, (double) one_thread_ns / ns,
+			100 * strip_wait_fraction(ns),
+			(unsigned long long) hash,
+			hash == expected ? "" : "  MISMATCH");
+
+		if (hash != expected)
+			ok = false;
+	}
+
+	return ok ? 0 : 1;
+}
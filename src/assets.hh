@@ -0,0 +1,55 @@
+/* Generated by convert -- do not edit. Only the format of the data
+ * is in here, so this only changes along with convert. */
+
+#ifndef ASSETS_HH
+#define ASSETS_HH
+
+#include <stdint.h>
+
+struct special_port {
+	uint16_t position;
+	uint8_t gravity;
+	uint8_t freeze_zonks;
+	uint8_t freeze_enemies;
+	uint8_t unused;
+};
+
+struct level {
+	uint32_t field; /* Offset into level_fields */
+	uint32_t objects; /* Index into level_objects */
+	uint16_t nr_objects;
+	uint8_t murphy_x;
+	uint8_t murphy_y;
+	uint8_t name[24];
+	uint8_t gravity;
+	uint8_t freeze_zonks;
+	uint16_t nr_infotrons; /* Number of infotrons needed */
+	uint8_t nr_special_ports;
+	uint8_t unused[3];
+	struct special_port special_ports[10];
+};
+
+/* Defined in assets.s. The size of each part of the data is in
+ * bytes. */
+extern "C" {
+extern const uint32_t nr_levels;
+
+extern const uint16_t palettes[];
+extern const uint32_t palettes_size;
+extern const uint32_t fixed[];
+extern const uint32_t fixed_size;
+extern const uint16_t fixed_map[];
+extern const uint32_t fixed_map_size;
+extern const uint32_t moving[];
+extern const uint32_t moving_size;
+extern const uint16_t moving_frames[];
+extern const uint32_t moving_frames_size;
+extern const struct level levels[];
+extern const uint32_t levels_size;
+extern const uint8_t level_fields[];
+extern const uint32_t level_fields_size;
+extern const uint16_t level_objects[];
+extern const uint32_t level_objects_size;
+}
+
+#endif
@@ -3,21 +3,105 @@
 
 #include <stdint.h>
 
+/* The game field is 60x24 cells, the size of a Supaplex level. The host
+ * build can simulate bigger fields by defining FIELD_WIDTH and
+ * FIELD_HEIGHT (the level is then repeated to fill it, see load_level()).
+ *
+ * By default, cell (x, y) is stored at index field_width * y + x, so the
+ * cells to the left and right of one on the edge of the field are on the
+ * previous and next row. Supaplex levels have a border of hardware around
+ * them, so this normally doesn't matter.
+ *
+ * Define FIELD_PADDED to use a stride of the next power of two instead
+ * (64 for a normal field), with a sentinel row above and below the field:
+ * cell (x, y) is then stored at index field_stride * (y + 1) + x, and the
+ * columns past the end of each row and the extra rows hold walls that
+ * never change. Every neighbour of a cell on the field is then either on
+ * the field or a wall, whatever the level has along its edges. */
+#ifndef FIELD_WIDTH
+#define FIELD_WIDTH 60
+#endif
+
+#ifndef FIELD_HEIGHT
+#define FIELD_HEIGHT 24
+#endif
+
+static const unsigned int field_width = FIELD_WIDTH;
+static const unsigned int field_height = FIELD_HEIGHT;
+
+static_assert(field_width >= 60 && field_height >= 24,
+	"the field must be big enough for a level");
+
+/* The smallest power of two that is bigger than n */
+constexpr unsigned int padded_stride(unsigned int n, unsigned int stride = 1)
+{
+	return stride > n ? stride : padded_stride(n, 2 * stride);
+}
+
+#ifdef FIELD_PADDED
+static const unsigned int field_stride = padded_stride(field_width);
+static const unsigned int field_size = field_stride * (field_height + 2);
+#else
+static const unsigned int field_stride = field_width;
+static const unsigned int field_size = field_width * field_height;
+#endif
+
+/* An index into the field; 16 bits is enough unless it's a big one */
+template<bool big>
+struct field_index_type {
+	typedef uint16_t type;
+};
+
+template<>
+struct field_index_type<true> {
+	typedef uint32_t type;
+};
+
+typedef field_index_type<(field_size > 0x10000)>::type field_index;
+
 /* Pass by value */
 class coordinate {
 public:
-	uint16_t raw;
+	field_index raw;
 
-	explicit coordinate(uint16_t raw):
+	explicit coordinate(field_index raw):
 		raw(raw)
 	{
 	}
 
+#ifdef FIELD_PADDED
+	/* field_stride is a power of two, so these are shifts and masks */
+	coordinate(unsigned int x, unsigned int y):
+		raw((y + 1) * field_stride + x)
+	{
+	}
+
+	unsigned int x() const
+	{
+		return raw % field_stride;
+	}
+
+	unsigned int y() const
+	{
+		return raw / field_stride - 1;
+	}
+#else
 	coordinate(unsigned int x, unsigned int y):
-		raw(60 * y + x)
+		raw(field_width * y + x)
 	{
 	}
 
+	unsigned int x() const
+	{
+		return raw % field_width;
+	}
+
+	unsigned int y() const
+	{
+		return raw / field_width;
+	}
+#endif
+
 	coordinate next() const
 	{
 		return coordinate(raw - 1);
@@ -35,15 +119,15 @@ public:
 
 	coordinate above() const
 	{
-		return coordinate(raw - 60);
+		return coordinate(raw - field_stride);
 	}
 
 	coordinate below() const
 	{
-		return coordinate(raw + 60);
+		return coordinate(raw + field_stride);
 	}
 
-	operator uint16_t() const
+	operator field_index() const
 	{
 		return raw;
 	}
@@ -0,0 +1,78 @@
+@ Start-up code: the cartridge header, followed by code that sets up the
+@ stacks, copies IWRAM code and initialised data out of the GamePak ROM,
+@ clears BSS, runs static constructors and finally calls main().
+
+	.section .crt0, "ax"
+	.arm
+	.align	2
+
+	.global	_start
+_start:
+	b	start
+
+	@ The Nintendo logo and the header checksum need to be filled in
+	@ after linking (e.g. with gbafix) for the game to boot with a real
+	@ Nintendo BIOS.
+	.fill	156, 1, 0	@ Nintendo logo
+	.fill	12, 1, 0	@ Game title
+	.fill	4, 1, 0		@ Game code
+	.byte	0x30, 0x31	@ Maker code
+	.byte	0x96		@ Fixed value
+	.byte	0x00		@ Main unit code
+	.byte	0x00		@ Device type
+	.fill	7, 1, 0		@ Reserved
+	.byte	0x00		@ Software version
+	.byte	0x00		@ Header checksum
+	.fill	2, 1, 0		@ Reserved
+
+start:
+	@ IRQ mode stack
+	mov	r0, #0x12
+	msr	cpsr_c, r0
+	ldr	sp, =__sp_irq
+
+	@ System mode stack
+	mov	r0, #0x1f
+	msr	cpsr_c, r0
+	ldr	sp, =__sp_usr
+
+	ldr	r0, =__iwram_lma
+	ldr	r1, =__iwram_start
+	ldr	r2, =__iwram_end
+	bl	copy
+
+	ldr	r0, =__data_lma
+	ldr	r1, =__data_start
+	ldr	r2, =__data_end
+	bl	copy
+
+	ldr	r1, =__bss_start
+	ldr	r2, =__bss_end
+	mov	r3, #0
+1:	cmp	r1, r2
+	strlo	r3, [r1], #4
+	blo	1b
+
+	ldr	r4, =__init_array_start
+	ldr	r5, =__init_array_end
+2:	cmp	r4, r5
+	bhs	3f
+	ldr	r0, [r4], #4
+	mov	lr, pc
+	bx	r0
+	b	2b
+
+3:	ldr	r0, =main
+	mov	lr, pc
+	bx	r0
+	b	.
+
+@ Copy words from r0 to r1 until r1 reaches r2
+copy:
+	cmp	r1, r2
+	ldrlo	r3, [r0], #4
+	strlo	r3, [r1], #4
+	blo	copy
+	bx	lr
+
+	.pool
@@ -4,28 +4,96 @@
 #include <stdint.h>
 
 #include "element_type.hh"
+#include "lookup_table.hh"
 
-class element {
+enum element_trait {
+	TRAIT_ROUND		= 1 << 0,
+	TRAIT_EDIBLE		= 1 << 1,
+	TRAIT_EXPLODABLE	= 1 << 2,
+
+	/* Things fall into these (space and reserved cells) */
+	TRAIT_EMPTY		= 1 << 3,
+
+	/* Objects that gravity acts on (see falling_objects in game.hh) */
+	TRAIT_FALLS		= 1 << 4,
+
+	/* Space and nothing else; objects only roll into this */
+	TRAIT_SPACE		= 1 << 5,
+};
+
+struct element_traits {
+	typedef uint8_t value_type;
+
+	static constexpr uint8_t entry(unsigned int code)
+	{
+		return ((code == ELEMENT_CHIP_SQUARE
+				|| code == ELEMENT_CHIP_VERTICAL_TOP
+				|| code == ELEMENT_CHIP_HORIZONTAL_LEFT
+				|| code == ELEMENT_CHIP_HORIZONTAL_RIGHT
+				|| code == ELEMENT_ZONK
+				|| code == ELEMENT_INFOTRON) ? TRAIT_ROUND : 0)
+			| ((code == ELEMENT_SPACE
+				|| code == ELEMENT_BASE
+				|| code == ELEMENT_INFOTRON
+				|| code == ELEMENT_DISK_RED
+				|| code == ELEMENT_BUG) ? TRAIT_EDIBLE : 0)
+			| ((code != ELEMENT_WALL
+				&& code != ELEMENT_WALL_INVISIBLE
+				&& (code < ELEMENT_HARDWARE_1 || code > ELEMENT_HARDWARE_7)) ? TRAIT_EXPLODABLE : 0)
+			| ((code == ELEMENT_SPACE
+				|| code == ELEMENT_RESERVED) ? TRAIT_EMPTY : 0)
+			| ((code == ELEMENT_ZONK
+				|| code == ELEMENT_INFOTRON) ? TRAIT_FALLS : 0)
+			| ((code == ELEMENT_SPACE) ? TRAIT_SPACE : 0);
+	}
+};
+
+/* The traits of every element type, computed by the compiler. This is
+ * looked up for every neighbour of every object we update, so it lives in
+ * IWRAM (see lookup_table.hh). */
+typedef lookup_table<element_traits, NR_ELEMENTS> element_traits_table;
+
+static_assert(sizeof(element_traits_table::table) == NR_ELEMENTS,
+	"element trait table has the wrong size");
+
+/* A cell of the game field. This is a template so that the same interface
+ * works whether the field is separate arrays of codes and frames (byte =
+ * uint8_t &, see field in game.hh) or an array of these (byte = uint8_t). */
+template<typename byte>
+class basic_element {
 public:
-	uint8_t code;
-	uint8_t frame;
+	byte code;
+	byte frame;
 
-	element()
+	basic_element()
 	{
 	}
 
-	explicit element(element_type code):
+	explicit basic_element(element_type code):
 		code(code),
 		frame(0)
 	{
 	}
 
-	void operator=(element_type new_code)
+	basic_element(uint8_t &code, uint8_t &frame):
+		code(code),
+		frame(frame)
 	{
-		code = new_code;
-		frame = 0;
 	}
 
+	/* Copy a cell out of the field, whatever its layout */
+	template<typename other>
+	basic_element(const basic_element<other> &e):
+		code(e.code),
+		frame(e.frame)
+	{
+	}
+
+	/* This is defined in game.hh, since changing the code of an
+	 * element on the game field must also update the list of active
+	 * cells. Only use it on elements that live in field[]. */
+	void operator=(element_type new_code);
+
 	/* XXX: Needed? */
 	bool is_space() const
 	{
@@ -42,31 +110,29 @@ public:
 		return code == ELEMENT_EXIT;
 	}
 
-	bool is_round() const
+	uint8_t traits() const
+	{
+		return element_traits_table::table[code];
+	}
+
+	bool has_trait(element_trait trait) const
 	{
-		if (code == ELEMENT_CHIP_SQUARE || code == ELEMENT_CHIP_VERTICAL_TOP)
-			return true;
-		if (code == ELEMENT_CHIP_HORIZONTAL_LEFT || code == ELEMENT_CHIP_HORIZONTAL_RIGHT)
-			return true;
+		return traits() & trait;
+	}
 
-		return code == ELEMENT_ZONK || code == ELEMENT_INFOTRON;
+	bool is_round() const
+	{
+		return has_trait(TRAIT_ROUND);
 	}
 
 	bool is_edible() const
 	{
-		return code == ELEMENT_SPACE
-			|| code == ELEMENT_BASE
-			|| code == ELEMENT_INFOTRON
-			|| code == ELEMENT_DISK_RED
-			|| code == ELEMENT_BUG;
+		return has_trait(TRAIT_EDIBLE);
 	}
 
 	bool is_explodable() const
 	{
-		if (code == ELEMENT_WALL || code == ELEMENT_WALL_INVISIBLE)
-			return false;
-
-		return code < ELEMENT_HARDWARE_1 || code > ELEMENT_HARDWARE_7;
+		return has_trait(TRAIT_EXPLODABLE);
 	}
 
 	bool is_reserved() const
@@ -86,4 +152,9 @@ public:
 	}
 };
 
+typedef basic_element<uint8_t> element;
+
+/* What field[] returns (unless FIELD_AOS is defined, see game.hh) */
+typedef basic_element<uint8_t &> element_ref;
+
 #endif
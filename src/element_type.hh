@@ -62,6 +62,13 @@ enum element_type {
 	ELEMENT_ZONK_ROLLING_RIGHT_RIGHT,
 	ELEMENT_ZONK_ROLLING_RIGHT_LEFT,
 
+	ELEMENT_INFOTRON_FALLING_DOWN_TOP,
+	ELEMENT_INFOTRON_FALLING_DOWN_BOTTOM,
+	ELEMENT_INFOTRON_ROLLING_LEFT_LEFT,
+	ELEMENT_INFOTRON_ROLLING_LEFT_RIGHT,
+	ELEMENT_INFOTRON_ROLLING_RIGHT_RIGHT,
+	ELEMENT_INFOTRON_ROLLING_RIGHT_LEFT,
+
 	NR_ELEMENTS,
 };
 
@@ -0,0 +1,1170 @@
+#ifndef GAME_HH
+#define GAME_HH
+
+/* The game engine proper: the game field, the element update functions
+ * and the Murphy state machine. Nothing in here touches the hardware, so
+ * it can be built for the host as well as for the GBA. */
+
+#include <stdint.h>
+
+#include "assert.hh"
+#include "assets.hh"
+#include "coordinate.hh"
+#include "element_type.hh"
+#include "level.hh"
+#include "lookup_table.hh"
+#include "profile.hh"
+#include "section.hh"
+
+/* We could put this in the GamePak ROM, however, the GamePak ROM has
+ * horrible memory access latency compared with the internal WRAM. So
+ * since this memory is used in a rather timing-sensitive operation
+ * (updating the game field) we prefer to construct it at run-time. */
+static void (*elements[NR_ELEMENTS])(const coordinate);
+
+
+#include "element.hh"
+
+/* Murphy's state */
+enum murphy_action {
+	MURPHY_FACING,
+	MURPHY_MOVING,
+};
+
+enum murphy_facing {
+	MURPHY_FACING_LEFT,
+	MURPHY_FACING_RIGHT,
+};
+
+enum murphy_direction {
+	MURPHY_LEFT,
+	MURPHY_RIGHT,
+	MURPHY_UP,
+	MURPHY_DOWN,
+};
+
+static_assert(field_width <= 0x1000 && field_height <= 0x1000,
+	"Murphy's position must fit in 16 bits");
+
+/* The game field. The element codes and frames are kept in two separate
+ * arrays: most scans of the field only look at the codes, and with them
+ * packed together we can read four at a time (see load_level()). Define
+ * FIELD_AOS to get a plain array of elements instead. Either way
+ * game->field[c] gives you something that behaves like an element. */
+#ifndef FIELD_AOS
+class game_field {
+public:
+	uint8_t codes[field_size] __attribute__ ((aligned (4)));
+	uint8_t frames[field_size];
+
+	element_ref operator[](unsigned int c)
+	{
+		return element_ref(codes[c], frames[c]);
+	}
+};
+#endif
+
+/* The gravity shortcuts in update_field() keep a whole row of the game
+ * field in a uint64_t, so they only work for fields of up to 64 columns.
+ * Bigger ones (see coordinate.hh) update every object on its own. */
+#if FIELD_WIDTH <= 64
+#define ROW_BITMAPS
+#endif
+
+/* Game variables: everything that changes as a game is played */
+struct game_state {
+	/* This goes first, so that it is as aligned as the whole thing */
+#ifndef FIELD_AOS
+	game_field field;
+#else
+	element field[field_size];
+#endif
+
+	unsigned int current_level;
+
+	/* Level properties (see struct level) */
+	bool gravity;
+	bool freeze_zonks;
+	uint16_t nr_infotrons_needed;
+
+	enum murphy_action murphy_state;
+	enum murphy_facing murphy_facing_direction;
+	enum murphy_direction murphy_moving_direction;
+
+	uint16_t murphy_frame;
+
+	/* The lower 4 bits are in pixels, while the rest give the
+	 * position on the game field. */
+	uint16_t murphy_x;
+	uint16_t murphy_y;
+
+	/* One bit per cell of the game field, set if the element in that
+	 * cell has an update function. Most of the field is walls, bases
+	 * and space, so this lets update_field() skip straight to the cells
+	 * that actually do something. */
+	uint32_t active[(field_size + 31) / 32];
+
+	/* One bit per cell of the game field, set if the element code in
+	 * that cell changed since the last time the screen was drawn. */
+	uint32_t changed[(field_size + 31) / 32];
+
+#ifdef ROW_BITMAPS
+	/* Bit x of row y is set if the cell at (x, y) is space (or
+	 * reserved), round, or an object that falls, respectively. These
+	 * are kept up to date by element::operator=() so that gravity can
+	 * be checked for a whole row at a time (see update_field()). */
+	uint64_t empty_rows[field_height];
+	uint64_t round_rows[field_height];
+	uint64_t falling_rows[field_height];
+#endif
+
+	/* The keypad state of the last tick (see update_keypad()) */
+	uint16_t keypad_prev;
+};
+
+/* The game that the engine works on. The GBA only ever has the one. The
+ * host tools may play several at once, one per thread (see batch.cc),
+ * by pointing this at their own. */
+static game_state default_game;
+
+#ifdef __arm__
+static game_state *const game = &default_game;
+#else
+static thread_local game_state *game = &default_game;
+#endif
+
+static __iwram void update_active(coordinate c)
+{
+	uint32_t bit = 1 << (c & 31);
+
+	if (elements[game->field[c].code])
+		game->active[c >> 5] |= bit;
+	else
+		game->active[c >> 5] &= ~bit;
+}
+
+/* Objects that find nothing to do (e.g. a zonk resting on a wall) may
+ * put themselves to sleep so that update_field() skips them until
+ * something happens next to them. */
+static __iwram_inline void deactivate(coordinate c)
+{
+	game->active[c >> 5] &= ~(1 << (c & 31));
+}
+
+/* Wake up the 3x3 neighbourhood of a cell that just changed. An object
+ * only ever looks at its immediate neighbours when deciding what to do,
+ * so a sleeping object can't have anything new to do until one of them
+ * changes. */
+static __iwram void wake(coordinate c)
+{
+	for (int dy = -(int) field_stride; dy <= (int) field_stride; dy += field_stride) {
+		for (int dx = -1; dx <= 1; ++dx) {
+			field_index n = c + dy + dx;
+			if (n >= field_size)
+				continue;
+
+			if (elements[game->field[n].code])
+				game->active[n >> 5] |= 1 << (n & 31);
+		}
+	}
+}
+
+static void mark_all_changed()
+{
+	for (unsigned int i = 0; i < sizeof(game->changed) / sizeof(*game->changed); ++i)
+		game->changed[i] = ~0;
+}
+
+static __iwram_inline void clear_changed()
+{
+	for (unsigned int i = 0; i < sizeof(game->changed) / sizeof(*game->changed); ++i)
+		game->changed[i] = 0;
+}
+
+/* Return the bits of one of the bitmaps above for the n (at most 16)
+ * cells starting at c, which must all be on the same row. */
+static __iwram_inline uint16_t field_bits(const uint32_t *bitmap, coordinate c, unsigned int n)
+{
+	unsigned int i = c >> 5;
+	unsigned int shift = c & 31;
+
+	uint32_t bits = bitmap[i] >> shift;
+	if (shift + n > 32)
+		bits |= bitmap[i + 1] << (32 - shift);
+
+	return bits & ((1 << n) - 1);
+}
+
+#ifdef ROW_BITMAPS
+
+/* Return the field_width bits of one of the bitmaps above for row y of
+ * the game field */
+static __iwram_inline uint64_t row_bits(const uint32_t *bitmap, unsigned int y)
+{
+	unsigned int i = coordinate(0, y) >> 5;
+	unsigned int shift = coordinate(0, y) & 31;
+
+	uint64_t bits = (bitmap[i] >> shift) | ((uint64_t) bitmap[i + 1] << (32 - shift));
+	if (shift + field_width > 64)
+		bits |= (uint64_t) bitmap[i + 2] << (64 - shift);
+
+	return bits & (~(uint64_t) 0 >> (64 - field_width));
+}
+
+static __iwram_inline void clear_row_bits(uint32_t *bitmap, unsigned int y, uint64_t bits)
+{
+	unsigned int i = coordinate(0, y) >> 5;
+	unsigned int shift = coordinate(0, y) & 31;
+
+	bitmap[i] &= ~(uint32_t) (bits << shift);
+	bitmap[i + 1] &= ~(uint32_t) (bits >> (32 - shift));
+	if (shift + field_width > 64)
+		bitmap[i + 2] &= ~(uint32_t) (bits >> (64 - shift));
+}
+
+static __iwram_inline void update_rows(coordinate c)
+{
+	unsigned int y = c.y();
+	unsigned int x = c.x();
+
+	const element &e = game->field[c];
+	uint64_t bit = (uint64_t) 1 << x;
+
+	game->empty_rows[y] = (game->empty_rows[y] & ~bit)
+		| ((uint64_t) e.has_trait(TRAIT_EMPTY) << x);
+	game->round_rows[y] = (game->round_rows[y] & ~bit)
+		| ((uint64_t) e.has_trait(TRAIT_ROUND) << x);
+	game->falling_rows[y] = (game->falling_rows[y] & ~bit)
+		| ((uint64_t) e.has_trait(TRAIT_FALLS) << x);
+}
+#else
+static __iwram_inline void update_rows(coordinate)
+{
+}
+#endif
+
+#ifndef FIELD_AOS
+template<>
+inline __iwram void element_ref::operator=(element_type new_code)
+{
+	code = new_code;
+	frame = 0;
+
+	coordinate c(&code - game->field.codes);
+#else
+template<>
+inline __iwram void element::operator=(element_type new_code)
+{
+	code = new_code;
+	frame = 0;
+
+	coordinate c(this - game->field);
+#endif
+	game->changed[c >> 5] |= 1 << (c & 31);
+	update_rows(c);
+	update_active(c);
+	wake(c);
+}
+
+/* Set a cell without any of the bookkeeping that element::operator=()
+ * does. Only for load_level(), which sets up the rest afterwards. */
+static inline void init_cell(coordinate c, element_type code)
+{
+#ifndef FIELD_AOS
+	game->field.codes[c] = code;
+	game->field.frames[c] = 0;
+#else
+	game->field[c] = element(code);
+#endif
+}
+
+/* How many copies of a level fit on the field */
+static const unsigned int nr_level_columns = field_width / 60;
+static const unsigned int nr_level_rows = field_height / 24;
+
+static __rom void load_level(unsigned int level)
+{
+	const struct level *l = &levels[level];
+
+#ifdef FIELD_PADDED
+	/* Everything that isn't on the field is a wall */
+	for (unsigned int i = 0; i < field_size; ++i)
+		init_cell(coordinate(i), ELEMENT_WALL);
+#endif
+
+	/* Initialise game variables */
+	decode_level(*l, [](unsigned int x, unsigned int y, element_type code) {
+		init_cell(coordinate(x, y), code);
+	});
+
+	/* A field that is bigger than a level (see coordinate.hh) gets as
+	 * many copies of it as fit, and walls in whatever is left over */
+	if (field_width > 60 || field_height > 24) {
+		for (unsigned int y = 0; y < field_height; ++y) {
+			for (unsigned int x = 0; x < field_width; ++x) {
+				if (x < 60 && y < 24)
+					continue;
+
+				if (x < 60 * nr_level_columns && y < 24 * nr_level_rows) {
+					element e = game->field[coordinate(x % 60, y % 24)];
+					init_cell(coordinate(x, y), (element_type) e.code);
+				} else {
+					init_cell(coordinate(x, y), ELEMENT_WALL);
+				}
+			}
+		}
+	}
+
+#if defined(ROW_BITMAPS) && !defined(FIELD_AOS)
+	static_assert(field_stride % 4 == 0, "rows must start on a word boundary");
+
+	/* Each row is field_width / 4 words of codes. The GBA is little
+	 * endian (like the x86 hosts), so the first cell is in the lowest
+	 * byte. */
+	for (unsigned int y = 0; y < field_height; ++y) {
+		uint64_t empty = 0;
+		uint64_t round = 0;
+		uint64_t falling = 0;
+
+		const uint32_t *codes = (const uint32_t *) &game->field.codes[coordinate(0, y)];
+		for (unsigned int x = 0; x < field_width; x += 4) {
+			uint32_t four = *codes++;
+
+			for (unsigned int j = 0; j < 4; ++j, four >>= 8) {
+				uint8_t traits = element_traits_table::table[four & 0xff];
+
+				empty |= (uint64_t) !!(traits & TRAIT_EMPTY) << (x + j);
+				round |= (uint64_t) !!(traits & TRAIT_ROUND) << (x + j);
+				falling |= (uint64_t) !!(traits & TRAIT_FALLS) << (x + j);
+			}
+		}
+
+		game->empty_rows[y] = empty;
+		game->round_rows[y] = round;
+		game->falling_rows[y] = falling;
+	}
+#elif defined(ROW_BITMAPS)
+	for (unsigned int y = 0; y < field_height; ++y) {
+		game->empty_rows[y] = 0;
+		game->round_rows[y] = 0;
+		game->falling_rows[y] = 0;
+
+		for (unsigned int x = 0; x < field_width; ++x) {
+			const element &e = game->field[coordinate(x, y)];
+
+			game->empty_rows[y] |= (uint64_t) e.has_trait(TRAIT_EMPTY) << x;
+			game->round_rows[y] |= (uint64_t) e.has_trait(TRAIT_ROUND) << x;
+			game->falling_rows[y] |= (uint64_t) e.has_trait(TRAIT_FALLS) << x;
+		}
+	}
+#endif
+
+	/* Only the cells that convert found objects in can have anything
+	 * to do; everything else starts out inactive. */
+	for (unsigned int i = 0; i < sizeof(game->active) / sizeof(*game->active); ++i)
+		game->active[i] = 0;
+
+	/* These are 60 * y + x, whatever the layout of field[] */
+	const uint16_t *objects = level_objects + l->objects;
+	for (unsigned int ty = 0; ty < nr_level_rows; ++ty) {
+		for (unsigned int tx = 0; tx < nr_level_columns; ++tx) {
+			for (unsigned int i = 0; i < l->nr_objects; ++i) {
+				update_active(coordinate(60 * tx + objects[i] % 60,
+					24 * ty + objects[i] / 60));
+			}
+		}
+	}
+
+	mark_all_changed();
+
+	game->gravity = l->gravity;
+	game->freeze_zonks = l->freeze_zonks;
+	game->nr_infotrons_needed = l->nr_infotrons;
+
+	/* convert has already replaced Murphy with space in the field. On a
+	 * bigger field, he's in the first copy of the level. */
+	game->murphy_state = MURPHY_FACING;
+	game->murphy_facing_direction = MURPHY_FACING_RIGHT;
+	game->murphy_moving_direction = MURPHY_RIGHT;
+	game->murphy_frame = 0;
+	game->murphy_x = l->murphy_x << 4;
+	game->murphy_y = l->murphy_y << 4;
+}
+
+/* Element update functions. These only change the field through their
+ * writer, which is one of: */
+
+/* Change the field as we go (see update_field()) */
+struct write_in_place {
+	static __iwram_inline bool next_frame(coordinate c)
+	{
+		return game->field[c].next_frame();
+	}
+
+	static __iwram_inline void write(coordinate c, element_type code)
+	{
+		game->field[c] = code;
+	}
+
+	static __iwram_inline void rest(coordinate c)
+	{
+		deactivate(c);
+	}
+};
+
+#ifdef TWO_PHASE_UPDATE
+/* Leave the field alone and record what the update function wants to do
+ * in *planning instead (see update_field()) */
+struct write_intent {
+	static __iwram_inline bool next_frame(coordinate c);
+	static __iwram_inline void write(coordinate c, element_type code);
+	static __iwram_inline void rest(coordinate c);
+};
+#endif
+
+template<typename writer>
+static __iwram void update_murphy_moving(const coordinate c)
+{
+	if (writer::next_frame(c))
+		writer::write(c, ELEMENT_SPACE);
+}
+
+/* Gravity. Zonks and infotrons fall and roll off round things in exactly
+ * the same way, so instead of a handler for each, what an object does is
+ * looked up from a signature of its neighbourhood: */
+enum gravity_signature {
+	GRAVITY_BELOW_EMPTY		= 1 << 0,
+	GRAVITY_BELOW_ROUND		= 1 << 1,
+	GRAVITY_RIGHT_SPACE		= 1 << 2,
+	GRAVITY_BELOW_RIGHT_SPACE	= 1 << 3,
+	GRAVITY_LEFT_SPACE		= 1 << 4,
+	GRAVITY_BELOW_LEFT_SPACE	= 1 << 5,
+
+	NR_GRAVITY_SIGNATURES		= 1 << 6,
+};
+
+enum gravity_action {
+	GRAVITY_REST,
+	GRAVITY_FALL,
+	GRAVITY_ROLL_RIGHT,
+	GRAVITY_ROLL_LEFT,
+};
+
+/* XXX: Check priority */
+struct gravity_rule {
+	typedef uint8_t value_type;
+
+	static constexpr uint8_t entry(unsigned int signature)
+	{
+		return (signature & GRAVITY_BELOW_EMPTY) ? GRAVITY_FALL
+			: !(signature & GRAVITY_BELOW_ROUND) ? GRAVITY_REST
+			: ((signature & GRAVITY_RIGHT_SPACE)
+				&& (signature & GRAVITY_BELOW_RIGHT_SPACE)) ? GRAVITY_ROLL_RIGHT
+			: ((signature & GRAVITY_LEFT_SPACE)
+				&& (signature & GRAVITY_BELOW_LEFT_SPACE)) ? GRAVITY_ROLL_LEFT
+			: GRAVITY_REST;
+	}
+};
+
+typedef lookup_table<gravity_rule, NR_GRAVITY_SIGNATURES> gravity_rules;
+
+/* The cells involved in moving an object. Each falling object has its own
+ * element type for each of these (see falling_objects). */
+enum gravity_role {
+	/* The cells it is moving out of */
+	ROLE_FALLING_DOWN_TOP,
+	ROLE_ROLLING_LEFT_RIGHT,
+	ROLE_ROLLING_RIGHT_LEFT,
+
+	/* The cells it is moving into */
+	ROLE_FALLING_DOWN_BOTTOM,
+	ROLE_ROLLING_LEFT_LEFT,
+	ROLE_ROLLING_RIGHT_RIGHT,
+
+	/* Kept free so that nothing falls into the path of a rolling
+	 * object */
+	ROLE_RESERVED,
+
+	NR_GRAVITY_ROLES,
+};
+
+/* What each action writes to the field, relative to the object and in
+ * this order */
+static struct gravity_transition {
+	uint8_t nr_cells;
+	struct {
+		int16_t offset;
+		uint8_t role;
+	} cells[3];
+} gravity_transitions[] = {
+	/* GRAVITY_REST */
+	{ 0, {} },
+
+	/* GRAVITY_FALL */
+	{ 2, {
+		{ 0, ROLE_FALLING_DOWN_TOP },
+		{ field_stride, ROLE_FALLING_DOWN_BOTTOM },
+	} },
+
+	/* GRAVITY_ROLL_RIGHT */
+	{ 3, {
+		{ field_stride + 1, ROLE_RESERVED },
+		{ 1, ROLE_ROLLING_RIGHT_RIGHT },
+		{ 0, ROLE_ROLLING_RIGHT_LEFT },
+	} },
+
+	/* GRAVITY_ROLL_LEFT */
+	{ 3, {
+		{ field_stride - 1, ROLE_RESERVED },
+		{ -1, ROLE_ROLLING_LEFT_LEFT },
+		{ 0, ROLE_ROLLING_LEFT_RIGHT },
+	} },
+};
+
+/* Objects that gravity acts on. Adding one only takes an entry here, its
+ * element types in element_type.hh, TRAIT_FALLS in element.hh and its
+ * sprites in draw_sprites(). The signature bits that aren't in the mask
+ * are ignored, so e.g. an object that never rolls would only have
+ * GRAVITY_BELOW_EMPTY. The states are in the order of enum gravity_role. */
+static struct falling_object {
+	element_type code;
+	uint8_t signature_mask;
+	element_type states[NR_GRAVITY_ROLES];
+} falling_objects[] = {
+	{ ELEMENT_ZONK, NR_GRAVITY_SIGNATURES - 1, {
+		ELEMENT_ZONK_FALLING_DOWN_TOP,
+		ELEMENT_ZONK_ROLLING_LEFT_RIGHT,
+		ELEMENT_ZONK_ROLLING_RIGHT_LEFT,
+		ELEMENT_ZONK_FALLING_DOWN_BOTTOM,
+		ELEMENT_ZONK_ROLLING_LEFT_LEFT,
+		ELEMENT_ZONK_ROLLING_RIGHT_RIGHT,
+		ELEMENT_RESERVED,
+	} },
+	{ ELEMENT_INFOTRON, NR_GRAVITY_SIGNATURES - 1, {
+		ELEMENT_INFOTRON_FALLING_DOWN_TOP,
+		ELEMENT_INFOTRON_ROLLING_LEFT_RIGHT,
+		ELEMENT_INFOTRON_ROLLING_RIGHT_LEFT,
+		ELEMENT_INFOTRON_FALLING_DOWN_BOTTOM,
+		ELEMENT_INFOTRON_ROLLING_LEFT_LEFT,
+		ELEMENT_INFOTRON_ROLLING_RIGHT_RIGHT,
+		ELEMENT_RESERVED,
+	} },
+};
+
+/* Index into falling_objects for each of their element types (filled in
+ * by init_elements()) */
+static uint8_t falling_object_index[NR_ELEMENTS];
+
+template<typename writer>
+static __iwram void update_falling(const coordinate c)
+{
+	coordinate below = c.below();
+
+	uint8_t traits = game->field[below].traits();
+	unsigned int signature = (!!(traits & TRAIT_EMPTY) * GRAVITY_BELOW_EMPTY)
+		| (!!(traits & TRAIT_ROUND) * GRAVITY_BELOW_ROUND);
+
+	/* The sides only matter if there's something round to roll off */
+	if (signature & GRAVITY_BELOW_ROUND) {
+		signature |= (!!game->field[c.right()].has_trait(TRAIT_SPACE) * GRAVITY_RIGHT_SPACE)
+			| (!!game->field[below.right()].has_trait(TRAIT_SPACE) * GRAVITY_BELOW_RIGHT_SPACE)
+			| (!!game->field[c.left()].has_trait(TRAIT_SPACE) * GRAVITY_LEFT_SPACE)
+			| (!!game->field[below.left()].has_trait(TRAIT_SPACE) * GRAVITY_BELOW_LEFT_SPACE);
+	}
+
+	const falling_object &o = falling_objects[falling_object_index[game->field[c].code]];
+
+	unsigned int action = gravity_rules::table[signature & o.signature_mask];
+	if (action == GRAVITY_REST) {
+		writer::rest(c);
+		return;
+	}
+
+	const gravity_transition &t = gravity_transitions[action];
+	for (unsigned int i = 0; i < t.nr_cells; ++i)
+		writer::write(coordinate(c + t.cells[i].offset), o.states[t.cells[i].role]);
+}
+
+/* The half of a falling or rolling object that it is moving out of */
+template<typename writer>
+static __iwram void update_falling_leaving(const coordinate c)
+{
+	if (writer::next_frame(c))
+		writer::write(c, ELEMENT_SPACE);
+}
+
+/* The half of a falling or rolling object that it is moving into */
+template<typename writer>
+static __iwram void update_falling_arriving(const coordinate c)
+{
+	if (writer::next_frame(c))
+		writer::write(c, falling_objects[falling_object_index[game->field[c].code]].code);
+}
+
+/* The update functions, and which element types they are for. This is a
+ * template specialisation per type so that the compiler knows them all;
+ * types that aren't listed here have none. It is what fills in
+ * elements[] and element_updates[] (see init_elements()). */
+enum element_update {
+	UPDATE_NONE,
+	UPDATE_MURPHY_MOVING,
+	UPDATE_FALLING,
+	UPDATE_FALLING_LEAVING,
+	UPDATE_FALLING_ARRIVING,
+
+	NR_ELEMENT_UPDATES,
+};
+
+template<element_update update>
+struct element_update_function {
+	/* For elements[] */
+	static constexpr void (*in_place)(const coordinate) = 0;
+
+	template<typename writer>
+	static __iwram_inline void run(const coordinate)
+	{
+	}
+};
+
+#define UPDATE_FUNCTION(update, function) \
+	template<> \
+	struct element_update_function<update> { \
+		static constexpr void (*in_place)(const coordinate) = \
+			&function<write_in_place>; \
+	\
+		template<typename writer> \
+		static __iwram_inline void run(const coordinate c) \
+		{ \
+			function<writer>(c); \
+		} \
+	};
+
+UPDATE_FUNCTION(UPDATE_MURPHY_MOVING, update_murphy_moving)
+UPDATE_FUNCTION(UPDATE_FALLING, update_falling)
+UPDATE_FUNCTION(UPDATE_FALLING_LEAVING, update_falling_leaving)
+UPDATE_FUNCTION(UPDATE_FALLING_ARRIVING, update_falling_arriving)
+
+#undef UPDATE_FUNCTION
+
+template<element_type type>
+struct element_handler {
+	static const element_update update = UPDATE_NONE;
+};
+
+#define ELEMENT_HANDLER(type, function) \
+	template<> \
+	struct element_handler<type> { \
+		static const element_update update = function; \
+	};
+
+/* Every falling object needs this as well as its falling_objects entry */
+#define FALLING_OBJECT_HANDLERS(object) \
+	ELEMENT_HANDLER(ELEMENT_##object, UPDATE_FALLING) \
+	ELEMENT_HANDLER(ELEMENT_##object##_FALLING_DOWN_TOP, UPDATE_FALLING_LEAVING) \
+	ELEMENT_HANDLER(ELEMENT_##object##_FALLING_DOWN_BOTTOM, UPDATE_FALLING_ARRIVING) \
+	ELEMENT_HANDLER(ELEMENT_##object##_ROLLING_LEFT_LEFT, UPDATE_FALLING_ARRIVING) \
+	ELEMENT_HANDLER(ELEMENT_##object##_ROLLING_LEFT_RIGHT, UPDATE_FALLING_LEAVING) \
+	ELEMENT_HANDLER(ELEMENT_##object##_ROLLING_RIGHT_RIGHT, UPDATE_FALLING_ARRIVING) \
+	ELEMENT_HANDLER(ELEMENT_##object##_ROLLING_RIGHT_LEFT, UPDATE_FALLING_LEAVING)
+
+ELEMENT_HANDLER(ELEMENT_MURPHY_MOVING, UPDATE_MURPHY_MOVING)
+FALLING_OBJECT_HANDLERS(ZONK)
+FALLING_OBJECT_HANDLERS(INFOTRON)
+
+#undef FALLING_OBJECT_HANDLERS
+#undef ELEMENT_HANDLER
+
+/* The update function of each element type, for dispatch_element() */
+static uint8_t element_updates[NR_ELEMENTS];
+
+/* Fill in elements[0] to elements[n - 1] and element_updates[0] to
+ * element_updates[n - 1] */
+template<unsigned int n>
+struct register_element_handlers {
+	static void run()
+	{
+		const element_update update = element_handler<(element_type) (n - 1)>::update;
+
+		register_element_handlers<n - 1>::run();
+		elements[n - 1] = element_update_function<update>::in_place;
+		element_updates[n - 1] = update;
+	}
+};
+
+template<>
+struct register_element_handlers<0> {
+	static void run()
+	{
+	}
+};
+
+/* Call the update function of the element at c, with the given writer.
+ * The compiler can turn this switch into a jump table with each of the
+ * update functions inlined into it once. */
+template<typename writer>
+static __iwram_inline void dispatch_element(const coordinate c)
+{
+	static_assert(NR_ELEMENT_UPDATES == 5,
+		"every element_update needs a case in dispatch_element()");
+
+#define DISPATCH(update) \
+	case update: \
+		element_update_function<update>::run<writer>(c); \
+		break;
+
+	switch (element_updates[game->field[c].code]) {
+	DISPATCH(UPDATE_NONE)
+	DISPATCH(UPDATE_MURPHY_MOVING)
+	DISPATCH(UPDATE_FALLING)
+	DISPATCH(UPDATE_FALLING_LEAVING)
+	DISPATCH(UPDATE_FALLING_ARRIVING)
+	}
+
+#undef DISPATCH
+}
+
+/* Call the update function of the element at c. By default this goes
+ * through elements[]; define ELEMENT_SWITCH to use dispatch_element()
+ * instead. */
+#ifdef ELEMENT_SWITCH
+static __iwram_inline void update_element(const coordinate c)
+{
+	dispatch_element<write_in_place>(c);
+}
+#else
+static __iwram_inline void update_element(const coordinate c)
+{
+	elements[game->field[c].code](c);
+}
+#endif
+
+static void init_elements()
+{
+	/* Initialise element update functions. Static elements that get one
+	 * must also be in is_object() in convert.cc, or they won't be
+	 * activated when the level starts. */
+	register_element_handlers<NR_ELEMENTS>::run();
+
+	for (unsigned int i = 0; i < sizeof(falling_objects) / sizeof(*falling_objects); ++i) {
+		const falling_object &o = falling_objects[i];
+
+		falling_object_index[o.code] = i;
+		for (unsigned int j = 0; j < ROLE_RESERVED; ++j)
+			falling_object_index[o.states[j]] = i;
+	}
+}
+
+#ifdef ROW_BITMAPS
+/* Return the objects in row y that gravity may move: those that can fall
+ * into the space below them, and those resting on something round that
+ * may be able to roll off to either side. This may include objects that
+ * can't actually move (e.g. when a neighbour is reserved rather than
+ * space), but never leaves out one that can. Row y must not be the last
+ * row. */
+static __iwram_inline uint64_t gravity_candidates(unsigned int y)
+{
+	uint64_t below_empty = game->empty_rows[y + 1];
+	uint64_t below_round = game->round_rows[y + 1];
+
+	uint64_t falls = below_empty;
+	uint64_t rolls_right = (game->empty_rows[y] >> 1) & (below_empty >> 1);
+	uint64_t rolls_left = (game->empty_rows[y] << 1) & (below_empty << 1);
+
+	return game->falling_rows[y] & (falls | (below_round & (rolls_right | rolls_left)));
+}
+
+/* Objects in row y that gravity can't move right now would just
+ * deactivate themselves when their turn comes, so we may as well do that
+ * for the whole row at once. If anything next to one of them changes
+ * after this, it is woken up again and gets its turn as usual. (Without
+ * FIELD_PADDED, the edges are left alone since the neighbours of a cell
+ * there wrap around to the next/previous row.) */
+static __iwram_inline void deactivate_stuck(unsigned int y)
+{
+	if (y == field_height - 1)
+		return;
+
+#ifdef FIELD_PADDED
+	uint64_t edges = ~(uint64_t) 0 >> (64 - field_width);
+#else
+	uint64_t edges = (~(uint64_t) 0 >> (65 - field_width)) & ~(uint64_t) 1;
+#endif
+
+	uint64_t stuck = row_bits(game->active, y) & game->falling_rows[y] & ~gravity_candidates(y)
+		& edges;
+
+	if (stuck)
+		clear_row_bits(game->active, y, stuck);
+}
+#endif
+
+#ifndef TWO_PHASE_UPDATE
+/* Update the active cells in words first to last - 1 of active[], in scan
+ * order */
+static __iwram void update_cells(unsigned int first, unsigned int last)
+{
+#ifdef ROW_BITMAPS
+	/* Rows before this have been through deactivate_stuck() */
+	unsigned int next_row_start = 0;
+#endif
+
+	for (unsigned int i = first; i < last; ++i) {
+		/* The update functions may activate or deactivate cells that
+		 * come later in the same word, so we need to re-read it after
+		 * each call. This visits cells in exactly the same order as a
+		 * scan over the whole field would. */
+		uint32_t mask = ~0;
+		uint32_t bits;
+
+		while ((bits = game->active[i] & mask)) {
+			unsigned int bit = __builtin_ctz(bits);
+			coordinate c(32 * i + bit);
+
+#ifdef ROW_BITMAPS
+			/* Deal with the rest of the row when we get to the
+			 * first object that gravity may act on */
+			if (c >= next_row_start && game->field[c].has_trait(TRAIT_FALLS)) {
+				unsigned int y = c.y();
+
+				deactivate_stuck(y);
+				next_row_start = coordinate(0, y + 1);
+				continue;
+			}
+#endif
+
+			mask = ~0U << bit << 1;
+			update_element(c);
+		}
+	}
+}
+
+static __iwram void update_field()
+{
+	update_cells(0, sizeof(game->active) / sizeof(*game->active));
+}
+
+#else
+/* Alternatively, the field can be updated in two phases: first all of the
+ * active objects work out what they want to do from the field as it was
+ * at the start of the tick, which doesn't change anything and so could be
+ * done in any order (or in parallel); then that is all done, in scan
+ * order. Define TWO_PHASE_UPDATE for this.
+ *
+ * The result is exactly that of the in-place update above. When an
+ * object's turn comes and a cell it looks at has been written since it
+ * made its plan (e.g. another zonk rolled into its way), it plans again
+ * from the field as it is now; cells that were woken up after planning
+ * (e.g. the bottom half of a falling zonk) are planned on the spot, so
+ * they still get updated in the tick they appear in. */
+
+/* What an update function wants to do to the field */
+struct intent {
+	field_index cell;
+
+	/* Move to the next frame */
+	bool advance;
+
+	/* Go to sleep (see deactivate()) */
+	bool rest;
+
+	/* Change these cells, in this order */
+	uint8_t nr_writes;
+	struct {
+		field_index cell;
+		uint8_t code;
+	} writes[3];
+};
+
+/* One for each active cell, at most. Unlike the game itself, this isn't
+ * part of struct game_state, so only one game can be updated at a time. */
+static __ewram struct intent intents[field_size];
+
+/* The intent that write_intent records into */
+static intent *planning;
+
+/* One bit per cell of the game field, set if an intent that has been
+ * carried out this tick wrote to it */
+static uint32_t written[(field_size + 31) / 32];
+
+inline bool write_intent::next_frame(coordinate c)
+{
+	planning->advance = true;
+	return game->field[c].frame + 1 >= 16;
+}
+
+inline void write_intent::write(coordinate c, element_type code)
+{
+	intent &t = *planning;
+
+	t.writes[t.nr_writes].cell = c;
+	t.writes[t.nr_writes].code = code;
+	++t.nr_writes;
+}
+
+inline void write_intent::rest(coordinate)
+{
+	planning->rest = true;
+}
+
+/* Work out what the object at c wants to do, into t */
+static __iwram_inline void plan_cell(const coordinate c, intent &t)
+{
+	t.cell = c;
+	t.advance = false;
+	t.rest = false;
+	t.nr_writes = 0;
+
+	planning = &t;
+	dispatch_element<write_intent>(c);
+}
+
+/* Plan the active cells in words first to last - 1 of active[], in scan
+ * order, into out. Returns the number of intents. Nothing changes the
+ * field or active[] in here, so the active cells could be planned in any
+ * order (or in parallel). */
+static __iwram unsigned int plan_cells(unsigned int first, unsigned int last,
+	intent *out)
+{
+	unsigned int nr_intents = 0;
+
+	for (unsigned int i = first; i < last; ++i) {
+		for (uint32_t bits = game->active[i]; bits; bits &= bits - 1) {
+			coordinate c(32 * i + __builtin_ctz(bits));
+			intent &t = out[nr_intents];
+
+			plan_cell(c, t);
+			if (t.advance || t.rest || t.nr_writes)
+				++nr_intents;
+		}
+	}
+
+	return nr_intents;
+}
+
+static __iwram_inline void clear_written()
+{
+	for (unsigned int i = 0; i < sizeof(written) / sizeof(*written); ++i)
+		written[i] = 0;
+}
+
+/* Whether a plan made for the object at c at the start of the tick may be
+ * out of date. An object only looks at its own cell, the ones to either
+ * side of it and the three below (see update_falling()), and only writes
+ * to those, so this also covers two objects wanting the same cell: the
+ * first one in scan order gets it, and the other one plans again. */
+static __iwram_inline bool plan_is_stale(const coordinate c)
+{
+	return field_bits(written, coordinate(c - 1), 3)
+		|| field_bits(written, coordinate(c + field_stride - 1), 3);
+}
+
+/* Carry out an intent */
+static __iwram_inline void commit_intent(const intent &t)
+{
+	if (t.advance)
+		game->field[t.cell].next_frame();
+
+	for (unsigned int j = 0; j < t.nr_writes; ++j) {
+		field_index n = t.writes[j].cell;
+
+		game->field[n] = (element_type) t.writes[j].code;
+		written[n >> 5] |= 1 << (n & 31);
+	}
+
+	if (t.rest)
+		deactivate(coordinate(t.cell));
+}
+
+/* Carry out the intents t[0] to t[nr_intents - 1] that plan_cells() made
+ * for words first to last - 1 of active[], in scan order. This visits the
+ * active cells just like the in-place update_field() does, re-reading
+ * each word as it goes, and plans again whatever has no plan or an out of
+ * date one. Parts of the field must be committed one after the other, top
+ * to bottom, with clear_written() before the first. */
+static __iwram void commit_cells(unsigned int first, unsigned int last,
+	const intent *t, unsigned int nr_intents)
+{
+	const intent *end = t + nr_intents;
+
+	for (unsigned int i = first; i < last; ++i) {
+		uint32_t mask = ~0;
+		uint32_t bits;
+
+		while ((bits = game->active[i] & mask)) {
+			unsigned int bit = __builtin_ctz(bits);
+			coordinate c(32 * i + bit);
+
+			mask = ~0U << bit << 1;
+
+			/* Cells that have gone to sleep since are skipped */
+			while (t != end && t->cell < c)
+				++t;
+
+			if (t != end && t->cell == c && !plan_is_stale(c)) {
+				commit_intent(*t);
+			} else {
+				intent u;
+
+				plan_cell(c, u);
+				commit_intent(u);
+			}
+		}
+	}
+}
+
+static __iwram void update_field()
+{
+	unsigned int nr_words = sizeof(game->active) / sizeof(*game->active);
+	unsigned int nr_intents = plan_cells(0, nr_words, intents);
+
+	clear_written();
+	commit_cells(0, nr_words, intents, nr_intents);
+}
+#endif
+
+static __iwram void update_murphy()
+{
+	switch (game->murphy_state) {
+	case MURPHY_FACING:
+		if (game->murphy_frame < 256)
+			++game->murphy_frame;
+		break;
+	case MURPHY_MOVING:
+		if (game->murphy_frame < 16) {
+			++game->murphy_frame;
+			if (game->murphy_frame == 16) {
+				game->murphy_state = MURPHY_FACING;
+				game->murphy_frame = 0;
+			}
+
+			switch (game->murphy_moving_direction) {
+			case MURPHY_LEFT:
+				--game->murphy_x;
+				break;
+			case MURPHY_RIGHT:
+				++game->murphy_x;
+				break;
+			case MURPHY_UP:
+				--game->murphy_y;
+				break;
+			case MURPHY_DOWN:
+				++game->murphy_y;
+				break;
+			}
+		}
+
+		break;
+	}
+}
+
+/* The keypad state uses the same bit layout as the KEYINPUT register,
+ * except that pressed keys are 1 rather than 0. */
+static __iwram void update_keypad(uint16_t keypad)
+{
+	uint16_t keypad_pressed = ~game->keypad_prev & keypad;
+
+	if (game->murphy_state == MURPHY_FACING) {
+		coordinate c(game->murphy_x >> 4, game->murphy_y >> 4);
+
+		if (keypad & (1 << 4)) {
+			/* Right */
+			game->murphy_facing_direction = MURPHY_FACING_RIGHT;
+			if (game->field[c.right()].is_edible()) {
+				game->field[c] = ELEMENT_MURPHY_MOVING;
+				/* XXX: */ game->field[c.right()] = ELEMENT_MURPHY_STANDING;
+				game->murphy_state = MURPHY_MOVING;
+				game->murphy_moving_direction = MURPHY_RIGHT;
+				game->murphy_frame = 0;
+			}
+		} else if (keypad & (1 << 5)) {
+			/* Left */
+			game->murphy_facing_direction = MURPHY_FACING_LEFT;
+			if (game->field[c.left()].is_edible()) {
+				game->field[c] = ELEMENT_MURPHY_MOVING;
+				/* XXX: */ game->field[c.left()] = ELEMENT_MURPHY_STANDING;
+				game->murphy_state = MURPHY_MOVING;
+				game->murphy_moving_direction = MURPHY_LEFT;
+				game->murphy_frame = 0;
+			}
+		} else if (keypad & (1 << 6)) {
+			/* Up */
+			if (game->field[c.above()].is_edible()) {
+				game->field[c] = ELEMENT_MURPHY_MOVING;
+				/* XXX: */ game->field[c.above()] = ELEMENT_MURPHY_STANDING;
+				game->murphy_state = MURPHY_MOVING;
+				game->murphy_moving_direction = MURPHY_UP;
+				game->murphy_frame = 0;
+			}
+		} else if (keypad & (1 << 7)) {
+			/* Down */
+			if (game->field[c.below()].is_edible()) {
+				game->field[c] = ELEMENT_MURPHY_MOVING;
+				/* XXX: */ game->field[c.below()] = ELEMENT_MURPHY_STANDING;
+				game->murphy_state = MURPHY_MOVING;
+				game->murphy_moving_direction = MURPHY_DOWN;
+				game->murphy_frame = 0;
+			}
+		}
+	}
+
+	if (keypad_pressed & (1 << 8)) {
+		/* R */
+		if (game->current_level < nr_levels - 1)
+			load_level(++game->current_level);
+	}
+
+	if (keypad_pressed & (1 << 9)) {
+		/* L */
+		if (game->current_level > 0)
+			load_level(--game->current_level);
+	}
+
+	game->keypad_prev = keypad;
+}
+
+/* Advance the game by one tick (one V-blank on the GBA) */
+static __iwram void update(uint16_t keypad)
+{
+	uint32_t start = profile_clock();
+	update_field();
+
+	uint32_t field_done = profile_clock();
+	update_murphy();
+	update_keypad(keypad);
+
+	profile_add(PROFILE_FIELD, field_done - start);
+	profile_add(PROFILE_MURPHY, profile_clock() - field_done);
+}
+
+/* FNV-1a over everything that update() may change. Two runs of the engine
+ * behave the same if they give the same hashes (see replay.cc and
+ * batch.cc). */
+static inline uint64_t hash_game()
+{
+	uint64_t hash = 14695981039346656037ULL;
+
+	for (unsigned int y = 0; y < field_height; ++y) {
+		for (unsigned int x = 0; x < field_width; ++x) {
+			element e = game->field[coordinate(x, y)];
+			hash = (hash ^ e.code) * 1099511628211ULL;
+			hash = (hash ^ e.frame) * 1099511628211ULL;
+		}
+	}
+
+	uint16_t murphy[] = {
+		(uint16_t) game->current_level,
+		game->murphy_state,
+		game->murphy_facing_direction,
+		game->murphy_moving_direction,
+		game->murphy_frame,
+		game->murphy_x,
+		game->murphy_y,
+	};
+
+	for (unsigned int i = 0; i < sizeof(murphy) / sizeof(*murphy); ++i)
+		hash = (hash ^ murphy[i]) * 1099511628211ULL;
+
+	return hash;
+}
+
+#endif
@@ -1,9 +1,16 @@
 #ifndef HALT_HH
 #define HALT_HH
 
+#ifndef __arm__
+#include <stdlib.h>
+#endif
+
 void halt()
 {
-#ifndef __thumb__
+#ifndef __arm__
+	/* Host build */
+	abort();
+#elif !defined(__thumb__)
 	asm volatile ("swi #0x260000"
 		:
 		:
@@ -0,0 +1,26 @@
+#ifndef HOST_HH
+#define HOST_HH
+
+/* Odds and ends shared by the host tools (bench.cc, replay.cc and so on).
+ * None of this is built for the GBA. */
+
+#ifdef __arm__
+#error "host.hh is only for the host tools"
+#endif
+
+#include <stdexcept>
+
+#include <stdint.h>
+#include <time.h>
+
+/* Nanoseconds from the monotonic clock */
+static inline uint64_t now()
+{
+	struct timespec ts;
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) == -1)
+		throw std::runtime_error("clock_gettime");
+
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+#endif
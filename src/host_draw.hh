@@ -0,0 +1,48 @@
+#ifndef HOST_DRAW_HH
+#define HOST_DRAW_HH
+
+/* A stand-in for the drawing done on the GBA, for timing it in the host
+ * tools (see bench.cc and replay.cc) */
+
+#include <stdint.h>
+
+#include "game.hh"
+
+/* What draw() and draw_sprites() in supaplex.cc read from the field, with
+ * the hardware left out: every tile of the field goes to a 64x32 map
+ * (wrapping around like the BG map does), and every active cell is looked
+ * at for a sprite. Returns something that depends on all of it, so that
+ * none of it can be optimised away. */
+static uint16_t bg_map[64 * 32];
+
+static inline unsigned int draw_field()
+{
+	for (unsigned int y = 0; y < field_height; ++y) {
+		for (unsigned int x = 0; x < field_width; ++x) {
+			unsigned int code = game->field[coordinate(x, y)].code;
+			if (code >= NR_STATIC_ELEMENTS)
+				code = ELEMENT_SPACE;
+
+			uint16_t *map = bg_map + 64 * (2 * (y & 15)) + 2 * (x & 31);
+			uint16_t tile = fixed_map[code] ^ ((fixed_map[code] >> 10) & 3);
+
+			map[0] = tile;
+			map[1] = tile ^ 1;
+			map[64] = tile ^ 2;
+			map[65] = tile ^ 3;
+		}
+	}
+
+	unsigned int sprites = 0;
+	for (unsigned int i = 0; i < sizeof(game->active) / sizeof(*game->active); ++i) {
+		for (uint32_t bits = game->active[i]; bits; bits &= bits - 1) {
+			element e = game->field[coordinate(32 * i + __builtin_ctz(bits))];
+			if (e.code >= NR_STATIC_ELEMENTS)
+				sprites += e.code + e.frame;
+		}
+	}
+
+	return sprites + bg_map[0];
+}
+
+#endif
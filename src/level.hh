@@ -0,0 +1,40 @@
+#ifndef LEVEL_HH
+#define LEVEL_HH
+
+#include <stdint.h>
+
+#include "assets.hh"
+#include "element_type.hh"
+
+/* Call fn(x, y, code) for each of the 60x24 cells of a level, in scan
+ * order. The field is run-length encoded (see encode_field() in
+ * convert.cc): each run is a byte with the element code in the lower 6
+ * bits and the length - 1 in the upper 2, where a length of 4 or more is
+ * followed by another byte with the length - 4. */
+template<typename function>
+static inline void decode_level(const struct level &l, function fn)
+{
+	const uint8_t *src = level_fields + l.field;
+
+	unsigned int x = 0;
+	unsigned int y = 0;
+
+	while (y < 24) {
+		uint8_t run = *src++;
+		element_type code = (element_type) (run & 0x3f);
+
+		unsigned int len = run >> 6;
+		if (len == 3)
+			len += *src++;
+
+		do {
+			fn(x, y, code);
+			if (++x == 60) {
+				x = 0;
+				++y;
+			}
+		} while (len--);
+	}
+}
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef LOOKUP_TABLE_HH
+#define LOOKUP_TABLE_HH
+
+/* A table of n entries computed by the compiler: entry i is
+ * generator::entry(i), which must be a constexpr function returning a
+ * generator::value_type. Use it as lookup_table<generator, n>::table.
+ *
+ * The table isn't const, so it goes in .data, which lives in IWRAM rather
+ * than the slow GamePak ROM (see gba.ld). Nothing should write to it. */
+
+template<typename generator, unsigned int... indices>
+struct lookup_table_data {
+	static typename generator::value_type table[sizeof...(indices)];
+};
+
+template<typename generator, unsigned int... indices>
+typename generator::value_type
+lookup_table_data<generator, indices...>::table[sizeof...(indices)] = {
+	generator::entry(indices)...
+};
+
+/* This expands to lookup_table_data<generator, 0, 1, ..., n - 1> */
+template<typename generator, unsigned int n, unsigned int... indices>
+struct lookup_table:
+	lookup_table<generator, n - 1, n - 1, indices...>
+{
+};
+
+template<typename generator, unsigned int... indices>
+struct lookup_table<generator, 0, indices...>:
+	lookup_table_data<generator, indices...>
+{
+};
+
+#endif
@@ -0,0 +1,163 @@
+#ifndef PROFILE_HH
+#define PROFILE_HH
+
+/* Per-frame profiling, enabled by building with -DPROFILE. On the GBA,
+ * time is counted in CPU cycles by timers 0 and 1, cascaded into a
+ * 32-bit counter; on the host it is in nanoseconds from the monotonic
+ * clock. Without PROFILE, all of this compiles to nothing. */
+
+#include <stdint.h>
+
+#include "section.hh"
+
+#if defined(PROFILE) && !defined(__arm__)
+#include <stdio.h>
+#include <time.h>
+#endif
+
+enum profile_phase {
+	PROFILE_DRAW,		/* BG map, sprites and OAM (draw_field() on the host) */
+	PROFILE_FIELD,		/* update_field() */
+	PROFILE_MURPHY,		/* update_murphy() and update_keypad() */
+	PROFILE_FRAME,		/* Everything done for one frame */
+
+	NR_PROFILE_PHASES,
+};
+
+/* A frame that takes longer than this is an overrun: 228 lines of 1232
+ * cycles each on the GBA, or the equivalent in nanoseconds on the host. */
+#ifdef __arm__
+#define PROFILE_FRAME_BUDGET 280896
+#else
+#define PROFILE_FRAME_BUDGET 16742706
+#endif
+
+struct profile_stats {
+	uint32_t min;
+	uint32_t max;
+	uint64_t total;
+	uint32_t nr_frames;
+};
+
+#ifdef PROFILE
+
+static struct {
+	struct profile_stats phases[NR_PROFILE_PHASES];
+	uint32_t nr_overruns;
+} profile;
+
+static __iwram_inline uint32_t profile_clock()
+{
+#ifdef __arm__
+	/* The two halves can't be read at the same time, so make sure the
+	 * upper half didn't change while we were reading the lower half. */
+	uint16_t hi;
+	uint16_t lo;
+
+	do {
+		hi = *(volatile uint16_t *) 0x04000104;
+		lo = *(volatile uint16_t *) 0x04000100;
+	} while (hi != *(volatile uint16_t *) 0x04000104);
+
+	return ((uint32_t) hi << 16) | lo;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint32_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+static void profile_init()
+{
+	for (unsigned int i = 0; i < NR_PROFILE_PHASES; ++i) {
+		profile.phases[i].min = ~0;
+		profile.phases[i].max = 0;
+		profile.phases[i].total = 0;
+		profile.phases[i].nr_frames = 0;
+	}
+
+	profile.nr_overruns = 0;
+
+#ifdef __arm__
+	/* Timer 1 counts timer 0 overflows; timer 0 counts cycles */
+	*(volatile uint16_t *) 0x04000100 = 0;
+	*(volatile uint16_t *) 0x04000104 = 0;
+	*(volatile uint16_t *) 0x04000106 = (1 << 2) | (1 << 7);
+	*(volatile uint16_t *) 0x04000102 = (1 << 7);
+#endif
+}
+
+static __iwram_inline void profile_add(enum profile_phase phase, uint32_t time)
+{
+	struct profile_stats *stats = &profile.phases[phase];
+
+	if (time < stats->min)
+		stats->min = time;
+	if (time > stats->max)
+		stats->max = time;
+
+	stats->total += time;
+	++stats->nr_frames;
+
+	if (phase == PROFILE_FRAME && time > PROFILE_FRAME_BUDGET)
+		++profile.nr_overruns;
+}
+
+static inline uint32_t profile_avg(enum profile_phase phase)
+{
+	const struct profile_stats *stats = &profile.phases[phase];
+
+	if (!stats->nr_frames)
+		return 0;
+
+	return stats->total / stats->nr_frames;
+}
+
+#ifndef __arm__
+static inline void profile_print(FILE *fp)
+{
+	static const char *names[] = {
+		"draw",
+		"field",
+		"murphy",
+		"frame",
+	};
+
+	fprintf(fp, "%-8s %10s %10s %10s (ns)\n", "phase", "min", "avg", "max");
+
+	for (unsigned int i = 0; i < NR_PROFILE_PHASES; ++i) {
+		const struct profile_stats *stats = &profile.phases[i];
+
+		if (!stats->nr_frames) {
+			fprintf(fp, "%-8s %10s %10s %10s\n", names[i], "-", "-", "-");
+			continue;
+		}
+
+		fprintf(fp, "%-8s %10u %10u %10u\n", names[i],
+			stats->min, profile_avg((enum profile_phase) i), stats->max);
+	}
+
+	fprintf(fp, "%u overruns in %u frames\n", profile.nr_overruns,
+		profile.phases[PROFILE_FRAME].nr_frames);
+}
+#endif
+
+#else
+
+static __iwram_inline uint32_t profile_clock()
+{
+	return 0;
+}
+
+static inline void profile_init()
+{
+}
+
+static __iwram_inline void profile_add(enum profile_phase phase, uint32_t time)
+{
+}
+
+#endif
+
+#endif
@@ -0,0 +1,134 @@
+#ifndef REPLAY_HH
+#define REPLAY_HH
+
+/* Keypad input recording and replay. Everything the game does is a
+ * function of the level it started on and the keypad state at each
+ * tick, so a recording of those two is enough to reproduce a run
+ * exactly, both on the GBA and with the host replay runner (replay.cc).
+ *
+ * A recording must be started right after the level is loaded at boot,
+ * since update_keypad() remembers the keypad state of the last tick. */
+
+#include <stdint.h>
+
+#include "assets.hh"
+#include "section.hh"
+
+#define RECORDING_MAGIC 0x31435253 /* "SRC1" */
+
+/* The keypad state (in the format that update() takes) for a number of
+ * consecutive ticks */
+struct input_run {
+	uint16_t keypad;
+	uint16_t length;
+};
+
+/* This is also the format of the recording in SRAM and in the files that
+ * the replay runner reads: little endian, with only the runs that are
+ * actually used. It takes up the first 28 KiB of SRAM; the rest is used
+ * for profiling data (see supaplex.cc). */
+struct recording {
+	uint32_t magic;
+	uint16_t level;
+	uint16_t nr_runs;
+	struct input_run runs[(28672 - 8) / 4];
+};
+
+static __ewram struct recording recording;
+
+static enum {
+	INPUT_LIVE,
+	INPUT_RECORDING,
+	INPUT_REPLAYING,
+} input_mode;
+
+/* Position of the next tick to replay */
+static unsigned int replay_run;
+static unsigned int replay_tick;
+
+static inline void start_recording(unsigned int level)
+{
+	recording.magic = RECORDING_MAGIC;
+	recording.level = level;
+	recording.nr_runs = 0;
+
+	input_mode = INPUT_RECORDING;
+}
+
+/* The recorder never makes a run of length 0, and input() would never get
+ * past one, so a recording that has one is junk */
+static inline bool has_empty_run(const struct recording &r)
+{
+	for (unsigned int i = 0; i < r.nr_runs; ++i) {
+		if (!r.runs[i].length)
+			return true;
+	}
+
+	return false;
+}
+
+/* The caller is expected to load recording.level first. A recording of
+ * a level we don't have (e.g. junk in SRAM that happens to start with
+ * the magic) isn't replayed, and neither is one with an empty run. */
+static inline bool start_replay()
+{
+	if (recording.magic != RECORDING_MAGIC || recording.level >= nr_levels
+		|| has_empty_run(recording))
+		return false;
+
+	replay_run = 0;
+	replay_tick = 0;
+
+	input_mode = INPUT_REPLAYING;
+	return true;
+}
+
+static bool replay_done()
+{
+	return replay_run >= recording.nr_runs;
+}
+
+/* Pass the keypad state for this tick through the recorder, or replace
+ * it with the recorded one. When a replay runs out, we go back to the
+ * live keypad. */
+static inline __rom uint16_t input(uint16_t keypad)
+{
+	switch (input_mode) {
+	case INPUT_LIVE:
+		break;
+	case INPUT_RECORDING: {
+		unsigned int n = recording.nr_runs;
+
+		if (n && recording.runs[n - 1].keypad == keypad
+			&& recording.runs[n - 1].length < 0xffff) {
+			++recording.runs[n - 1].length;
+		} else if (n < sizeof(recording.runs) / sizeof(*recording.runs)) {
+			recording.runs[n].keypad = keypad;
+			recording.runs[n].length = 1;
+			recording.nr_runs = n + 1;
+		} else {
+			/* Out of space */
+			input_mode = INPUT_LIVE;
+		}
+
+		break;
+	}
+	case INPUT_REPLAYING:
+		if (replay_done()) {
+			input_mode = INPUT_LIVE;
+			break;
+		}
+
+		keypad = recording.runs[replay_run].keypad;
+		if (++replay_tick == recording.runs[replay_run].length) {
+			++replay_run;
+			replay_tick = 0;
+		}
+
+		break;
+	}
+
+	return keypad;
+}
+
+#endif
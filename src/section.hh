@@ -0,0 +1,30 @@
+#ifndef SECTION_HH
+#define SECTION_HH
+
+/* Hot code goes in IWRAM and is compiled as ARM code; everything else is
+ * Thumb code in GamePak ROM (see make.sh and gba.ld). IWRAM and the
+ * GamePak ROM are too far apart for a BL, so any call that crosses
+ * between the two must be a long call. Helpers that __iwram code calls
+ * are either __iwram themselves or forced inline with __iwram_inline, so
+ * that they don't end up as Thumb code in ROM. (One-line accessors, like
+ * those of coordinate and element, are left to the compiler: a call
+ * would be bigger than they are, so they are always inlined anyway.) */
+#ifdef __arm__
+#define __iwram __attribute__ ((section(".iwram"), target("arm"), long_call))
+#define __iwram_inline inline __attribute__ ((always_inline))
+#define __rom __attribute__ ((long_call))
+#else
+#define __iwram
+#define __iwram_inline inline
+#define __rom
+#endif
+
+/* Large buffers that aren't accessed often go in the (slower) external
+ * WRAM. This isn't cleared at boot. */
+#ifdef __arm__
+#define __ewram __attribute__ ((section(".ewram")))
+#else
+#define __ewram
+#endif
+
+#endif
@@ -0,0 +1,147 @@
+#ifndef STRIPS_HH
+#define STRIPS_HH
+
+/* The in-place update_field() (see game.hh) split up over a thread pool,
+ * for big fields on the host (see coordinate.hh). The field is cut into
+ * strips of whole columns, one per thread, and each thread updates its
+ * strip a row at a time, in scan order.
+ *
+ * An object only looks at and writes to its own row and the one below,
+ * one column to either side, and wake() reaches one cell further. So row
+ * y of a strip comes out exactly as in a scan over the whole field once
+ * row y of the strip to its left and row y - 1 of the one to its right
+ * are done; the columns along the edges of a strip are its halo, which
+ * is what it waits for its neighbours to be done with. This makes a
+ * wavefront, with each strip about two rows behind the one to its left.
+ *
+ * Two strips that are busy at the same time always have another one in
+ * between them, so with at least 64 columns to a strip (and strips
+ * starting on a word of the bitmaps), they don't share any cells or any
+ * words of the bitmaps either. */
+
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+
+#include "game.hh"
+#include "host.hh"
+#include "thread_pool.hh"
+
+#ifdef TWO_PHASE_UPDATE
+#error "strips.hh updates the field in place, so it can't be built with TWO_PHASE_UPDATE"
+#endif
+
+static const unsigned int min_strip_columns = 64;
+
+static const unsigned int max_strips = 256;
+
+static struct strip {
+	unsigned int first_column;
+	unsigned int nr_columns;
+
+	/* Rows of this tick that are done */
+	std::atomic<unsigned int> nr_rows_done;
+
+	/* Time spent waiting for the neighbours since split_field() */
+	uint64_t wait_ns;
+} strips[max_strips];
+
+static unsigned int nr_strips;
+
+/* Cut the field into (at most) n strips of about the same width. A field
+ * that is too narrow for that gets fewer strips, and maybe only one; so
+ * does one whose rows don't start on a word of the bitmaps. */
+static void split_field(unsigned int n)
+{
+	if (n > max_strips)
+		n = max_strips;
+	if (field_stride % 32 != 0)
+		n = 1;
+
+	unsigned int nr_columns = (field_width + n - 1) / n;
+	if (nr_columns < min_strip_columns)
+		nr_columns = min_strip_columns;
+
+	nr_columns = (nr_columns + 31) / 32 * 32;
+
+	nr_strips = 0;
+	for (unsigned int x = 0; x < field_width; x += nr_columns) {
+		strip &s = strips[nr_strips++];
+
+		s.first_column = x;
+		s.nr_columns = nr_columns;
+		s.wait_ns = 0;
+	}
+
+	/* The last strip also gets the rest of the row (e.g. the padding
+	 * of a padded field) */
+	strip &last = strips[nr_strips - 1];
+	last.nr_columns = field_stride - last.first_column;
+}
+
+/* Wait until row nr_rows - 1 of s is done */
+static void wait_for_rows(const strip &s, unsigned int nr_rows, uint64_t &wait_ns)
+{
+	if (s.nr_rows_done.load(std::memory_order_acquire) >= nr_rows)
+		return;
+
+	uint64_t start = now();
+	while (s.nr_rows_done.load(std::memory_order_acquire) < nr_rows)
+		std::this_thread::yield();
+
+	wait_ns += now() - start;
+}
+
+static void update_strip(unsigned int i)
+{
+	strip &s = strips[i];
+
+	for (unsigned int y = 0; y < field_height; ++y) {
+		if (i > 0)
+			wait_for_rows(strips[i - 1], y + 1, s.wait_ns);
+		if (i + 1 < nr_strips)
+			wait_for_rows(strips[i + 1], y, s.wait_ns);
+
+		field_index first = coordinate(s.first_column, y);
+		update_cells(first >> 5, (first + s.nr_columns) >> 5);
+
+		s.nr_rows_done.store(y + 1, std::memory_order_release);
+	}
+}
+
+/* Call split_field() first. The pool must have a thread for each strip,
+ * since they wait for each other. The threads of the pool all work on
+ * the caller's game. */
+static void update_field_strips(thread_pool &pool)
+{
+	if (nr_strips > pool.size())
+		throw std::runtime_error("more strips than threads");
+
+	if (nr_strips == 1) {
+		update_field();
+		return;
+	}
+
+	for (unsigned int i = 0; i < nr_strips; ++i)
+		strips[i].nr_rows_done.store(0, std::memory_order_relaxed);
+
+	game_state *g = game;
+
+	pool.run(nr_strips, [g](unsigned int i) {
+		game = g;
+		update_strip(i);
+	});
+}
+
+/* The share of the time the threads spent waiting for each other since
+ * split_field(), out of ns for each of them */
+static double strip_wait_fraction(uint64_t ns)
+{
+	uint64_t wait_ns = 0;
+	for (unsigned int i = 0; i < nr_strips; ++i)
+		wait_ns += strips[i].wait_ns;
+
+	return (double) wait_ns / ns / nr_strips;
+}
+
+#endif
@@ -18,283 +18,326 @@
 
 #include <stdint.h>
 
-#include "assert.hh"
 #include "coordinate.hh"
 #include "element_type.hh"
-#include "graphics.cc" // XXX: fix
-#include "tile.hh"
+#include "game.hh"
+#include "replay.hh"
+#include "section.hh"
+
+/* Lookup table for mapping the game field to BG map tiles. Each entry is
+ * the BG map entry for the top-left 8x8 corner of the 16x16 tile; the
+ * others are the same entry XORed with 1 (top-right), 2 (bottom-left)
+ * and 3 (bottom-right), see draw_tile().
+ *
+ * This is used for every tile we draw, so we construct it at run-time
+ * (putting it in IWRAM) rather than leave it in the slow GamePak ROM. */
+static uint16_t tiles[NR_STATIC_ELEMENTS];
 
-#define __iwram __attribute__ ((section(".iwram")))
+static void init_tiles()
+{
+	/* convert gives us the tiles for all the elements up to (but not
+	 * including) the invisible wall, in order. Each is the first of
+	 * four consecutive tiles in VRAM (a multiple of 4) and the flip
+	 * bits. Tiles that are mirror images of each other share their 8x8
+	 * tiles, so a flipped tile has its corners swapped around: flipping
+	 * in X swaps the left and right ones, i.e. XORs the corner number
+	 * with 1, and flipping in Y XORs it with 2. */
+	for (unsigned int i = 0; i < ELEMENT_WALL_INVISIBLE; ++i)
+		tiles[i] = fixed_map[i] ^ ((fixed_map[i] >> 10) & 3);
 
-#define TILE(tile) \
-	{ \
-		4 * TILE ## _ ## tile + 0, \
-		4 * TILE ## _ ## tile + 1, \
-		4 * TILE ## _ ## tile + 2, \
-		4 * TILE ## _ ## tile + 3, \
-	}
+	/* Invisible wall */
+	tiles[ELEMENT_WALL_INVISIBLE] = tiles[ELEMENT_SPACE];
+}
 
-#define TILE_FLIP_X(tile) \
-	{ \
-		(4 * TILE ## _ ## tile + 1) | (1 << 10), \
-		(4 * TILE ## _ ## tile + 0) | (1 << 10), \
-		(4 * TILE ## _ ## tile + 3) | (1 << 10), \
-		(4 * TILE ## _ ## tile + 2) | (1 << 10), \
-	}
+/* Number of BG map entries written by the last call to draw(). This is
+ * shown by the profiling overlay (see draw_overlay()). */
+static unsigned int vram_writes;
 
-#define TILE_FLIP_Y(tile) \
-	{ \
-		(4 * TILE ## _ ## tile + 2) | (1 << 11), \
-		(4 * TILE ## _ ## tile + 3) | (1 << 11), \
-		(4 * TILE ## _ ## tile + 0) | (1 << 11), \
-		(4 * TILE ## _ ## tile + 1) | (1 << 11), \
-	}
+/* Write the 16x16 tile for the element at (x, y) on the game field to the
+ * BG map. The BG map is 64x32 8x8 tiles, i.e. 32x16 of our tiles, and is
+ * used as a ring buffer: field tile (x, y) always goes in (x % 32, y % 16)
+ * and the BG0 scroll registers follow the camera. */
+static __iwram void draw_tile(unsigned int x, unsigned int y)
+{
+	/* The visible window may stick out one tile past the field */
+	if (x >= field_width || y >= field_height)
+		return;
 
-/* 2 KiB lookup table for mapping the game field to BG map tiles */
-/* XXX: We could compress this to use only 2 bytes (instead of 8) per
- * 16x16 tile with some extra logic in the function that updates the
- * BG map. */
-/* XXX: This should go into WRAM. In other words, we should construct
- * it at run-time rather than make it const. */
-static const uint16_t tiles[][4] = {
-	TILE(SPACE),
-	TILE(ZONK),
-	TILE(BASE),
-	TILE(MURPHY),
-	TILE(INFOTRON),
-	TILE(CHIP_SQUARE),
-	TILE(WALL),
-	TILE(EXIT),
-	TILE(DISK_ORANGE),
-
-	/* Regular ports */
-	TILE(PORT_LEFT_TO_RIGHT),
-	TILE(PORT_UP_TO_DOWN),
-	TILE_FLIP_X(PORT_LEFT_TO_RIGHT),
-	TILE_FLIP_Y(PORT_UP_TO_DOWN),
-
-	/* Special ports (use the same tiles as regular ports) */
-	TILE(PORT_LEFT_TO_RIGHT),
-	TILE(PORT_UP_TO_DOWN),
-	TILE_FLIP_X(PORT_LEFT_TO_RIGHT),
-	TILE_FLIP_Y(PORT_UP_TO_DOWN),
-
-	TILE(SNIK_SNAK),
-	TILE(DISK_YELLOW),
-	TILE(TERMINAL),
-	TILE(DISK_RED),
-
-	/* Two- and four-way ports */
-	TILE(PORT_VERTICAL),
-	TILE(PORT_HORIZONTAL),
-	TILE(PORT_CROSS),
-
-	TILE(ELECTRON),
-
-	/* Bug */
-	TILE(BASE),
-
-	TILE(CHIP_HORIZONTAL_LEFT),
-	TILE(CHIP_HORIZONTAL_RIGHT),
-
-	TILE(HARDWARE_1),
-	TILE(HARDWARE_LAMP_GREEN),
-	TILE(HARDWARE_LAMP_BLUE),
-	TILE(HARDWARE_LAMP_RED),
-	TILE(HARDWARE_2),
-	TILE(HARDWARE_3),
-	TILE(HARDWARE_4),
-	TILE(HARDWARE_5),
-	TILE(HARDWARE_6),
-	TILE(HARDWARE_7),
-	TILE(CHIP_VERTICAL_TOP),
-	TILE(CHIP_VERTICAL_BOTTOM),
+	uint8_t code = game->field[coordinate(x, y)].code;
 
-	/* Invisible wall */
-	TILE(SPACE),
-};
+	/* Moving objects are drawn as sprites on top of space */
+	if (code >= NR_STATIC_ELEMENTS)
+		code = ELEMENT_SPACE;
 
-/* We could put this in the GamePak ROM, however, the GamePak ROM has
- * horrible memory access latency compared with the internal WRAM. So
- * since this memory is used in a rather timing-sensitive operation
- * (updating the game field) we prefer to construct it at run-time. */
-static void (*elements[NR_ELEMENTS])(const coordinate);
+	/* The left and right halves of the map are separate 32x32 screen
+	 * blocks */
+	unsigned int map_x = 2 * (x & 31);
+	unsigned int map_y = 2 * (y & 15);
+	uint16_t *map = (uint16_t *) 0x06008000
+		+ ((map_x & 32) << 5) + 32 * map_y + (map_x & 31);
 
+	uint16_t tile = tiles[code];
 
-/* Game variables */
+	map[0] = tile;
+	map[1] = tile ^ 1;
+	map[32] = tile ^ 2;
+	map[33] = tile ^ 3;
 
-static unsigned int current_level;
+	vram_writes += 4;
+}
 
-static enum {
-	MURPHY_FACING,
-	MURPHY_MOVING,
-} murphy_state;
+/* The camera is centered on Murphy except near the edges of the field.
+ * These return the position of the top-left corner of the (240x160)
+ * screen in pixels. They are inlined into draw() and draw_sprites(),
+ * which run from IWRAM (see section.hh). */
+static __iwram_inline uint16_t camera_x()
+{
+	if (game->murphy_x < 112)
+		return 0;
+	if (game->murphy_x >= 16 * field_width - (240 - 112))
+		return 16 * field_width - 240;
+	return game->murphy_x - 112;
+}
 
-static enum {
-	MURPHY_FACING_LEFT,
-	MURPHY_FACING_RIGHT,
-} murphy_facing_direction;
+static __iwram_inline uint16_t camera_y()
+{
+	if (game->murphy_y < 72)
+		return 0;
+	if (game->murphy_y >= 16 * field_height - (160 - 72))
+		return 16 * field_height - 160;
+	return game->murphy_y - 72;
+}
 
-static enum {
-	MURPHY_LEFT,
-	MURPHY_RIGHT,
-	MURPHY_UP,
-	MURPHY_DOWN,
-} murphy_moving_direction;
+static __iwram void draw()
+{
+	/* The GBA LCD is 240x160 pixels, and since we use 16x16 tiles, this
+	 * means we get 15x10 tiles on the screen. HOWEVER, scrolling may
+	 * cause us to display an extra row/an extra column, so we should
+	 * always have 16x11 tiles in the background map. */
+	uint16_t camera_x = ::camera_x();
+	uint16_t camera_y = ::camera_y();
+
+	uint16_t map_x = camera_x >> 4;
+	uint16_t map_y = camera_y >> 4;
+
+	/* Number of visible tiles that are actually on the field */
+	unsigned int width = field_width - map_x < 16 ? field_width - map_x : 16;
+	unsigned int height = field_height - map_y < 11 ? field_height - map_y : 11;
+
+	/* Update BG map. When the camera crosses a tile boundary, only the
+	 * newly exposed row and/or column needs to be written; apart from
+	 * that we only rewrite the tiles whose element code changed since
+	 * last time. */
+	static bool map_valid = false;
+	static uint16_t prev_map_x;
+	static uint16_t prev_map_y;
+
+	int dx = map_x - prev_map_x;
+	int dy = map_y - prev_map_y;
+	vram_writes = 0;
+
+	if (!map_valid || dx < -1 || dx > 1 || dy < -1 || dy > 1) {
+		/* Level (re)started; redraw everything */
+		for (uint16_t y = 0; y < 11; ++y) {
+			for (uint16_t x = 0; x < 16; ++x)
+				draw_tile(map_x + x, map_y + y);
+		}
+	} else {
+		if (dx) {
+			uint16_t x = dx > 0 ? map_x + 15 : map_x;
+			for (uint16_t y = 0; y < 11; ++y)
+				draw_tile(x, map_y + y);
+		}
 
-static uint16_t murphy_frame;
+		if (dy) {
+			uint16_t y = dy > 0 ? map_y + 10 : map_y;
+			for (uint16_t x = 0; x < 16; ++x)
+				draw_tile(map_x + x, y);
+		}
+
+		for (uint16_t y = 0; y < height; ++y) {
+			uint16_t bits = field_bits(game->changed, coordinate(map_x, map_y + y), width);
+
+			while (bits) {
+				unsigned int x = __builtin_ctz(bits);
+				bits &= bits - 1;
 
-/* The lower 4 bits are in pixels, while the next 6 bits give the position
- * on the game field. */
-static uint16_t murphy_x;
-static uint16_t murphy_y;
+				draw_tile(map_x + x, map_y + y);
+			}
+		}
+	}
 
-#include "element.hh"
+	clear_changed();
+	map_valid = true;
+	prev_map_x = map_x;
+	prev_map_y = map_y;
 
-static element field[60 * 24];
+	/* Update BG0 scroll/offset */
+	*(volatile uint16_t *) 0x04000010 = camera_x;
+	*(volatile uint16_t *) 0x04000012 = camera_y;
+}
 
-static void find_murphy()
+/* Copy memory using DMA 3; the CPU is stopped until the copy is done.
+ * The count is in halfwords or words, respectively. */
+static __iwram_inline void dma_copy16(void *dst, const void *src, unsigned int n)
 {
-	murphy_state = MURPHY_FACING;
-	murphy_facing_direction = MURPHY_FACING_RIGHT;
-	murphy_moving_direction = MURPHY_RIGHT;
-	murphy_frame = 0;
+	*(volatile const void **) 0x040000d4 = src;
+	*(volatile void **) 0x040000d8 = dst;
+	*(volatile uint32_t *) 0x040000dc = n | (1 << 31);
+}
 
-	/* Find the first instance of Murphy */
-	for (unsigned int y = 0; y < 24; ++y) {
-		for (unsigned int x = 0; x < 60; ++x) {
-			coordinate c(x, y);
+static __iwram_inline void dma_copy32(void *dst, const void *src, unsigned int n)
+{
+	*(volatile const void **) 0x040000d4 = src;
+	*(volatile void **) 0x040000d8 = dst;
+	*(volatile uint32_t *) 0x040000dc = n | (1 << 26) | (1 << 31);
+}
 
-			if (!field[c].is_murphy())
-				continue;
+/* Shadow copy of OAM. We fill this in after updating the game field and
+ * copy it to OAM with DMA at the start of the next V-blank, so that it
+ * matches the BG map drawn at that point. */
+static uint16_t oam[128 * 4] __attribute__ ((aligned(4)));
 
-			field[c] = ELEMENT_SPACE;
-			murphy_x = x << 4;
-			murphy_y = y << 4;
-			return;
-		}
-	}
+/* Number of sprites used in the shadow OAM */
+static uint8_t nr_sprites;
+
+/* Number of sprites that need to be copied to OAM; this is more than
+ * nr_sprites if we used more sprites the previous time around, since
+ * those need to be disabled. */
+static uint8_t nr_sprites_dirty;
 
-	assert(false);
+/* Sprite frames from convert, with the OBJ tile number in the lower 10
+ * bits and the flip bits in bits 10 and 11 (like a BG map entry). Frames
+ * that are mirror images of an earlier frame share its tiles. How many
+ * there are is only known at link time (see assets.hh), so this has room
+ * for more than convert makes. */
+#define MAX_SPRITE_FRAMES 128
+
+static uint16_t sprite_frames[MAX_SPRITE_FRAMES];
+
+/* Set the tile number of a sprite to that of the given frame. If the
+ * frame is stored flipped, the sprite is flipped (back) to match; this
+ * must be called after attr[1] has been set. */
+static __iwram_inline void set_sprite_frame(uint16_t *attr, unsigned int frame)
+{
+	uint16_t entry = sprite_frames[frame];
+
+	attr[1] ^= ((entry >> 10) & 3) << 12;
+	attr[2] = entry & 0x3ff;
 }
 
-static void load_level(unsigned int level)
+/* A falling object, drawn in the cell it is leaving; the frame counter
+ * is how far it has fallen in pixels */
+static __iwram_inline void draw_falling(uint16_t *attr, unsigned int x, unsigned int y,
+	unsigned int offset, unsigned int frame)
 {
-	/* Initialise game variables */
-	for (unsigned int y = 0; y < 24; ++y) {
-		for (unsigned int x = 0; x < 60; ++x)
-			field[coordinate(x, y)] = element((element_type) levels[level].field[y][x]);
-	}
+	attr[0] = y + offset;
+	attr[1] = x | (1 << 14);
+	set_sprite_frame(attr, frame);
+}
 
-	find_murphy();
+/* A rolling object; the sprite frames roll to the left, so rolling to
+ * the right is the same frames flipped */
+static __iwram_inline void draw_rolling(uint16_t *attr, unsigned int x, unsigned int y,
+	unsigned int frame, bool flip)
+{
+	attr[0] = y;
+	attr[1] = x | (flip << 12) | (1 << 14);
+	set_sprite_frame(attr, frame);
 }
 
-static void draw()
+static void init_sprites()
 {
-	/* The GBA LCD is 240x160 pixels, and since we use 16x16 tiles, this
-	 * means we get 15x10 tiles on the screen. HOWEVER, scrolling may
-	 * cause us to display an extra row/an extra column, so we should
-	 * always have 16x11 tiles in the background map. */
+	assert(moving_frames_size / 2 <= MAX_SPRITE_FRAMES);
+	for (unsigned int i = 0; i < moving_frames_size / 2; ++i)
+		sprite_frames[i] = moving_frames[i];
 
-	/* Calculate various positions and offsets */
-	uint16_t sprite_x;
-	uint16_t map_x;
-	uint16_t scroll_x;
-
-	if (murphy_x < 112) {
-		map_x = 0;
-		scroll_x = 0;
-		sprite_x = murphy_x;
-	} else if (murphy_x >= 832) {
-		map_x = 720 >> 4;
-		scroll_x = 0;
-		sprite_x = 112 + murphy_x - 832;
-	} else {
-		map_x = (murphy_x - 112) >> 4;
-		scroll_x = (murphy_x - 112) & 0xf;
-		sprite_x = 112;
-	}
+	for (unsigned int i = 0; i < 128; ++i)
+		oam[4 * i] = (1 << 9);
 
-	uint16_t sprite_y;
-	uint16_t map_y;
-	uint16_t scroll_y;
-
-	if (murphy_y < 72) {
-		map_y = 0;
-		scroll_y = 0;
-		sprite_y = murphy_y;
-	} else if (murphy_y >= 296) {
-		map_y = 224 >> 4;
-		scroll_y = 0;
-		sprite_y = 72 + murphy_y - 296;
-	} else {
-		map_y = (murphy_y - 72) >> 4;
-		scroll_y = (murphy_y - 72) & 0xf;
-		sprite_y = 72;
-	}
+	nr_sprites = 0;
+	nr_sprites_dirty = 128;
+}
+
+static __iwram void draw_sprites()
+{
+	uint16_t camera_x = ::camera_x();
+	uint16_t camera_y = ::camera_y();
+
+	uint16_t map_x = camera_x >> 4;
+	uint16_t map_y = camera_y >> 4;
+	uint16_t scroll_x = camera_x & 0xf;
+	uint16_t scroll_y = camera_y & 0xf;
 
-	/* Update BG map */
-	uint8_t sprite = 1;
+	unsigned int width = field_width - map_x < 16 ? field_width - map_x : 16;
+	unsigned int height = field_height - map_y < 11 ? field_height - map_y : 11;
 
-	for (uint16_t y = 0; y < 11; ++y) {
-		uint16_t _2y = y + y;
+	/* Moving objects are drawn as sprites. These are always active, so
+	 * we only need to look at the active cells. */
+	unsigned int sprite = 1;
 
-		for (uint16_t x = 0; x < 16; ++x) {
-			uint16_t _2x = x + x;
+	for (uint16_t y = 0; y < height; ++y) {
+		coordinate row(map_x, map_y + y);
+		uint16_t bits = field_bits(game->active, row, width);
 
-			element e = field[coordinate(map_x + x, map_y + y)];
+		while (bits && sprite < 128) {
+			unsigned int x = __builtin_ctz(bits);
+			bits &= bits - 1;
+
+			element e = game->field[coordinate(row + x)];
 			uint8_t code = e.code;
-			if (code >= NR_STATIC_ELEMENTS) {
-				/* Put these in an array of callbacks */
-				if (code == ELEMENT_ZONK_FALLING_DOWN_TOP) {
-					*((uint16_t *) 0x07000000 + 4 * sprite) = (16 * y - scroll_y + e.frame);
-					*((uint16_t *) 0x07000002 + 4 * sprite) = (16 * x - scroll_x) | (1 << 14);
-					*((uint16_t *) 0x07000004 + 4 * sprite) = 15 << 2;
-					++sprite;
-				}
+			uint16_t *attr = &oam[4 * sprite];
 
-				else if (code == ELEMENT_ZONK_ROLLING_LEFT_RIGHT) {
-					*((uint16_t *) 0x07000000 + 4 * sprite) = (16 * y - scroll_y);
-					*((uint16_t *) 0x07000002 + 4 * sprite) = (16 * x - scroll_x - e.frame) | (1 << 14);
-					*((uint16_t *) 0x07000004 + 4 * sprite) = (16 + (e.frame >> 2)) << 2;
-					++sprite;
-				}
+			unsigned int sprite_x = 16 * x - scroll_x;
+			unsigned int sprite_y = 16 * y - scroll_y;
 
-				else if (code == ELEMENT_ZONK_ROLLING_RIGHT_LEFT) {
-					*((uint16_t *) 0x07000000 + 4 * sprite) = (16 * y - scroll_y);
-					*((uint16_t *) 0x07000002 + 4 * sprite) = (16 * x - scroll_x + e.frame) | (1 << 12) | (1 << 14);
-					*((uint16_t *) 0x07000004 + 4 * sprite) = (16 + (e.frame >> 2)) << 2;
-					++sprite;
-				}
+			switch (code) {
+			case ELEMENT_ZONK_FALLING_DOWN_TOP:
+				draw_falling(attr, sprite_x, sprite_y, e.frame, 15);
+				break;
+			case ELEMENT_ZONK_ROLLING_LEFT_RIGHT:
+				draw_rolling(attr, sprite_x - e.frame, sprite_y, 16 + (e.frame >> 2), false);
+				break;
+			case ELEMENT_ZONK_ROLLING_RIGHT_LEFT:
+				draw_rolling(attr, sprite_x + e.frame, sprite_y, 16 + (e.frame >> 2), true);
+				break;
+
+			/* The first frame of the rolling infotron is the
+			 * infotron at rest */
+			case ELEMENT_INFOTRON_FALLING_DOWN_TOP:
+				draw_falling(attr, sprite_x, sprite_y, e.frame, 31);
+				break;
+			case ELEMENT_INFOTRON_ROLLING_LEFT_RIGHT:
+				draw_rolling(attr, sprite_x - e.frame, sprite_y, 31 + (e.frame >> 2), false);
+				break;
+			case ELEMENT_INFOTRON_ROLLING_RIGHT_LEFT:
+				draw_rolling(attr, sprite_x + e.frame, sprite_y, 31 + (e.frame >> 2), true);
+				break;
 
-				code = ELEMENT_SPACE;
+			default:
+				continue;
 			}
 
-			*((uint16_t *) 0x06008000 + 32 * (_2y + 0) + (_2x + 0)) = tiles[code][0];
-			*((uint16_t *) 0x06008000 + 32 * (_2y + 1) + (_2x + 0)) = tiles[code][2];
-			*((uint16_t *) 0x06008000 + 32 * (_2y + 0) + (_2x + 1)) = tiles[code][1];
-			*((uint16_t *) 0x06008000 + 32 * (_2y + 1) + (_2x + 1)) = tiles[code][3];
+			++sprite;
 		}
 	}
 
-	/* Update BG0 scroll/offset */
-	*(volatile uint16_t *) 0x04000010 = scroll_x;
-	*(volatile uint16_t *) 0x04000012 = scroll_y;
-
-	/* Update sprites */
+	/* Murphy */
+	uint16_t sprite_x = game->murphy_x - camera_x;
+	uint16_t sprite_y = game->murphy_y - camera_y;
 	uint16_t sprite_tile;
 	bool sprite_flip_x;
 
-	switch (murphy_state) {
+	switch (game->murphy_state) {
 	case MURPHY_FACING:
 		sprite_tile = 0;
 		break;
 	case MURPHY_MOVING:
-		sprite_tile = 0 + (murphy_frame >> 2);
+		sprite_tile = 0 + (game->murphy_frame >> 2);
 		break;
 	}
 
-	switch (murphy_facing_direction) {
+	switch (game->murphy_facing_direction) {
 	case MURPHY_LEFT:
 		sprite_flip_x = false;
 		break;
@@ -303,146 +346,243 @@ static void draw()
 		break;
 	}
 
-	*(uint16_t *) 0x07000000 = sprite_y;
-	*(uint16_t *) 0x07000002 = sprite_x | (sprite_flip_x << 12) | (1 << 14);
-	*(uint16_t *) 0x07000004 = sprite_tile << 2;
+	oam[0] = sprite_y;
+	oam[1] = sprite_x | (sprite_flip_x << 12) | (1 << 14);
+	set_sprite_frame(oam, sprite_tile);
+
+	/* Disable the sprites that were used last time but not now */
+	for (unsigned int i = sprite; i < nr_sprites; ++i)
+		oam[4 * i] = (1 << 9);
 
-	/* Disable remaining sprites */
-	for (; sprite < 128; ++sprite)
-		*((uint16_t *) 0x07000000 + 4 * sprite) = (1 << 9);
+	if (nr_sprites_dirty < nr_sprites)
+		nr_sprites_dirty = nr_sprites;
+	if (nr_sprites_dirty < sprite)
+		nr_sprites_dirty = sprite;
+
+	nr_sprites = sprite;
 }
 
-static void
-vblank_irq()
+/* Copy the shadow OAM to OAM (must be done during V-blank) */
+static __iwram void commit_sprites()
 {
-#if 0
-	/* Only process every second V-blank IRQ */
-	static uint8_t state = 0;
-	state = !state;
-	if (state)
+	if (!nr_sprites_dirty)
 		return;
-#endif
 
-	/* The first thing the V-blank IRQ handler should do is take care
-	 * that use the opportunity to update VRAM and the LCD parameters.
-	 * Then we may update the game field and do other stuff that
-	 * possibly carries over into the next display cycle. (That's fine;
-	 * the original Supaplex also run on hardware that was so slow that
-	 * it needed two screen refreshes to do everything, hence the need
-	 * for a speed fix on newer machines.) */
+	/* 2 words per sprite */
+	dma_copy32((void *) 0x07000000, oam, 2 * nr_sprites_dirty);
+	nr_sprites_dirty = 0;
+}
 
-	draw();
+/* Emulators and flash carts look for this to decide what kind of save
+ * memory the cartridge has */
+static const char sram_id[] __attribute__ ((used, aligned(4))) = "SRAM_V100";
 
-	/* Update game field */
-	for (uint16_t c = 0; c < 60 * 24; ++c) {
-		void (*fn)(const coordinate) = elements[field[coordinate(c)].code];
-		if (fn)
-			fn(coordinate(c));
-	}
+/* The recording is written to the cartridge SRAM as it is made, so that
+ * it can be replayed after a reset or dumped for the replay runner. Only
+ * the header and the last run can have changed since the last tick.
+ * SRAM can only be accessed 8 bits at a time. */
+static __iwram void save_recording()
+{
+	volatile uint8_t *sram = (volatile uint8_t *) 0x0e000000;
+	const uint8_t *data = (const uint8_t *) &recording;
 
-	/* Update the state of murphy */
-	switch (murphy_state) {
-	case MURPHY_FACING:
-		if (murphy_frame < 256)
-			++murphy_frame;
-		break;
-	case MURPHY_MOVING:
-		if (murphy_frame < 16) {
-			++murphy_frame;
-			if (murphy_frame == 16) {
-				murphy_state = MURPHY_FACING;
-				murphy_frame = 0;
-			}
+	unsigned int end = 8 + 4 * recording.nr_runs;
+	unsigned int start = recording.nr_runs ? end - 4 : 0;
 
-			switch (murphy_moving_direction) {
-			case MURPHY_LEFT:
-				--murphy_x;
-				break;
-			case MURPHY_RIGHT:
-				++murphy_x;
-				break;
-			case MURPHY_UP:
-				--murphy_y;
-				break;
-			case MURPHY_DOWN:
-				++murphy_y;
-				break;
-			}
-		}
+	for (unsigned int i = 0; i < 8; ++i)
+		sram[i] = data[i];
+	for (unsigned int i = start; i < end; ++i)
+		sram[i] = data[i];
+}
 
-		break;
-	}
+static void load_recording()
+{
+	volatile uint8_t *sram = (volatile uint8_t *) 0x0e000000;
+	uint8_t *data = (uint8_t *) &recording;
 
-	/* Deal with keypad changes */
-	static uint16_t keypad_prev = 0;
-	uint16_t keypad = ~*(volatile uint16_t *) 0x04000130;
-	uint16_t keypad_pressed = ~keypad_prev & keypad;
-	uint16_t keypad_released = keypad_prev & ~keypad;
-
-	if (murphy_state == MURPHY_FACING) {
-		coordinate c(murphy_x >> 4, murphy_y >> 4);
-
-		if (keypad & (1 << 4)) {
-			/* Right */
-			murphy_facing_direction = MURPHY_FACING_RIGHT;
-			if (field[c.right()].is_edible()) {
-				field[c] = ELEMENT_MURPHY_MOVING;
-				/* XXX: */ field[c.right()] = ELEMENT_MURPHY_STANDING;
-				murphy_state = MURPHY_MOVING;
-				murphy_moving_direction = MURPHY_RIGHT;
-				murphy_frame = 0;
-			}
-		} else if (keypad & (1 << 5)) {
-			/* Left */
-			murphy_facing_direction = MURPHY_FACING_LEFT;
-			if (field[c.left()].is_edible()) {
-				field[c] = ELEMENT_MURPHY_MOVING;
-				/* XXX: */ field[c.left()] = ELEMENT_MURPHY_STANDING;
-				murphy_state = MURPHY_MOVING;
-				murphy_moving_direction = MURPHY_LEFT;
-				murphy_frame = 0;
-			}
-		} else if (keypad & (1 << 6)) {
-			/* Up */
-			if (field[c.above()].is_edible()) {
-				field[c] = ELEMENT_MURPHY_MOVING;
-				/* XXX: */ field[c.above()] = ELEMENT_MURPHY_STANDING;
-				murphy_state = MURPHY_MOVING;
-				murphy_moving_direction = MURPHY_UP;
-				murphy_frame = 0;
-			}
-		} else if (keypad & (1 << 7)) {
-			/* Down */
-			if (field[c.below()].is_edible()) {
-				field[c] = ELEMENT_MURPHY_MOVING;
-				/* XXX: */ field[c.below()] = ELEMENT_MURPHY_STANDING;
-				murphy_state = MURPHY_MOVING;
-				murphy_moving_direction = MURPHY_DOWN;
-				murphy_frame = 0;
+	for (unsigned int i = 0; i < 8; ++i)
+		data[i] = sram[i];
+
+	if (recording.nr_runs > sizeof(recording.runs) / sizeof(*recording.runs)
+		|| recording.level >= nr_levels)
+		recording.magic = 0;
+	if (recording.magic != RECORDING_MAGIC)
+		return;
+
+	for (unsigned int i = 8; i < 8 + 4U * recording.nr_runs; ++i)
+		data[i] = sram[i];
+}
+
+/* Number of V-blanks so far; each one is a game tick */
+static volatile uint32_t ticks;
+
+/* Number of ticks the main loop has run update() for */
+static uint32_t ticks_done;
+
+/* Set by the main loop when the shadow OAM and the game field are ready
+ * to be shown, i.e. when draw() and commit_sprites() may be called. */
+static volatile bool frame_ready;
+
+/* Catching up on more ticks than this without drawing a frame would
+ * freeze the screen if the game were to fall behind for good; we draw
+ * a frame anyway and run the remaining ticks after that. */
+#define MAX_SKIPPED_FRAMES 4
+
+/* Number of frames that weren't drawn because the game fell behind */
+static uint32_t nr_skipped_frames;
+
+/* Time spent in the V-blank IRQ (for profiling) */
+static uint32_t commit_time;
+
+/* Number of CPU cycles from the start of main() until the first frame
+ * has been drawn. Divide by 1232 to get the number of scanlines. This is
+ * shown by the profiling overlay. */
+static uint32_t boot_cycles;
+
+#ifdef PROFILE
+/* Debug overlay on BG1, showing the profiling statistics as hex numbers.
+ * There is one row for each phase (draw, field, Murphy, whole frame)
+ * with the min, avg and max cycle counts, followed by a row with the
+ * number of overruns, the number of skipped frames and the number of BG
+ * map entries written in the last frame drawn, and one with the number
+ * of cycles it took to boot (see boot_cycles). */
+
+/* 3x5 pixel hex digits; each octal digit is one row of pixels */
+static const uint16_t overlay_font[16] = {
+	075557, 026227, 071747, 071717, 055711, 074717, 074757, 071111,
+	075757, 075717, 075755, 065656, 074447, 065556, 074747, 074744,
+};
+
+static void init_overlay()
+{
+	/* The font goes in character block 1; tile 0 is blank and tile 1 + n
+	 * is the hex digit n */
+	uint32_t *tiles = (uint32_t *) 0x06004000;
+
+	for (unsigned int y = 0; y < 8; ++y)
+		tiles[y] = 0;
+
+	for (unsigned int i = 0; i < 16; ++i) {
+		uint32_t *tile = tiles + 8 * (1 + i);
+
+		for (unsigned int y = 0; y < 8; ++y) {
+			uint32_t row = 0;
+
+			if (y >= 1 && y <= 5) {
+				unsigned int bits = (overlay_font[i] >> (3 * (5 - y))) & 7;
+
+				for (unsigned int x = 0; x < 3; ++x) {
+					if (bits & (4 >> x))
+						row |= 1 << (4 * (1 + x));
+				}
 			}
+
+			tile[y] = row;
 		}
 	}
 
-	if (keypad_pressed & (1 << 8)) {
-		/* R */
-		if (current_level < sizeof(levels) / sizeof(*levels) - 1)
-			load_level(++current_level);
+	/* White text (colour 1 of palette 15) */
+	*(volatile uint16_t *) 0x050001e2 = 0x7fff;
+
+	/* Screen block 18 holds the map */
+	uint16_t *map = (uint16_t *) 0x06009000;
+	for (unsigned int i = 0; i < 32 * 32; ++i)
+		map[i] = 0;
+
+	/* BG1 control; BG0 is moved behind it */
+	*(volatile uint16_t *) 0x0400000a = (1 << 2) | (18 << 8);
+	*(volatile uint16_t *) 0x04000008 |= 1;
+	*(volatile uint16_t *) 0x04000000 |= (1 << 9);
+}
+
+static void draw_overlay_number(uint16_t *map, uint32_t x)
+{
+	for (int i = 5; i >= 0; --i) {
+		map[i] = (1 + (x & 0xf)) | (15 << 12);
+		x >>= 4;
 	}
+}
+
+/* SRAM can only be written 8 bits at a time */
+static void save_sram(unsigned int offset, const void *data, unsigned int size)
+{
+	volatile uint8_t *sram = (volatile uint8_t *) 0x0e000000 + offset;
+
+	for (unsigned int i = 0; i < size; ++i)
+		sram[i] = ((const uint8_t *) data)[i];
+}
+
+/* The statistics are also saved to SRAM so that they can be dumped:
+ * "profile" (in the layout of profile.hh) at 0x7000, and the last
+ * two rows of the overlay as 32-bit numbers at 0x7100. We only do this every
+ * 32 frames, to avoid disturbing what we measure. */
+static __rom void draw_overlay()
+{
+	static unsigned int frame = 0;
+	if (++frame & 31)
+		return;
+
+	uint16_t *map = (uint16_t *) 0x06009000;
+
+	for (unsigned int i = 0; i < NR_PROFILE_PHASES; ++i) {
+		draw_overlay_number(map + 32 * i + 0, profile.phases[i].min);
+		draw_overlay_number(map + 32 * i + 7, profile_avg((enum profile_phase) i));
+		draw_overlay_number(map + 32 * i + 14, profile.phases[i].max);
+	}
+
+	draw_overlay_number(map + 32 * NR_PROFILE_PHASES + 0, profile.nr_overruns);
+	draw_overlay_number(map + 32 * NR_PROFILE_PHASES + 7, nr_skipped_frames);
+	draw_overlay_number(map + 32 * NR_PROFILE_PHASES + 14, vram_writes);
+	draw_overlay_number(map + 32 * (NR_PROFILE_PHASES + 1) + 0, boot_cycles);
+
+	uint32_t stats[] = {
+		profile.nr_overruns,
+		nr_skipped_frames,
+		vram_writes,
+		boot_cycles,
+	};
+
+	static_assert(sizeof(profile) <= 0x100, "profile overlaps the stats in SRAM");
+	save_sram(0x7000, &profile, sizeof(profile));
+	save_sram(0x7100, stats, sizeof(stats));
+}
+#else
+static inline void init_overlay()
+{
+}
+
+static inline void draw_overlay()
+{
+}
+#endif
 
-	if (keypad_pressed & (1 << 9)) {
-		/* L */
-		if (current_level > 0)
-			load_level(--current_level);
+static __iwram void
+vblank_irq()
+{
+	/* All we do here is update VRAM and OAM (while it is safe to do so)
+	 * and count the tick; the game logic runs in the main loop. If the
+	 * main loop is still busy with the previous tick(s), we leave the
+	 * screen alone and let it catch up. That way the game always runs
+	 * at the same speed and only the frame rate drops, much like the
+	 * speed fix for the original Supaplex. */
+	if (frame_ready) {
+		uint32_t start = profile_clock();
+		commit_sprites();
+		draw();
+		commit_time = profile_clock() - start;
+
+		frame_ready = false;
 	}
 
-	keypad_prev = keypad;
+	++ticks;
 }
 
-static void keypad_irq()
+static __iwram void keypad_irq()
 {
 }
 
-extern void irq()
+/* The BIOS calls this in ARM mode */
+extern __iwram void irq()
 {
 	uint16_t flags = *(volatile uint16_t *) 0x04000202;
 
@@ -473,101 +613,87 @@ static inline void vblank_wait()
 #endif
 }
 
-int main(void)
+/* Decompress LZ77 data (as produced by convert) into VRAM, which needs
+ * to be written 16 bits at a time. */
+static inline void lz77_decompress_vram(const void *src, void *dst)
 {
-	/* Initialise element update functions */
-	for (unsigned int i = 0; i < NR_ELEMENTS; ++i)
-		elements[i] = 0;
-
-	elements[ELEMENT_MURPHY_MOVING] = [](const coordinate c) {
-		if (field[c].next_frame())
-			field[c] = ELEMENT_SPACE;
-	};
-
-	elements[ELEMENT_ZONK] = [](const coordinate c) {
-		coordinate below = c.below();
-
-		if (field[below].is_space() || field[below].is_reserved()) {
-			/* Fall down */
-			field[c] = ELEMENT_ZONK_FALLING_DOWN_TOP;
-			field[below] = ELEMENT_ZONK_FALLING_DOWN_BOTTOM;
-		} else if (field[below].is_round()) {
-			/* Roll off (XXX: Check priority) */
-			if (field[c.right()].is_space() && field[below.right()].is_space()) {
-				field[below.right()] = ELEMENT_RESERVED;
-				field[c.right()] = ELEMENT_ZONK_ROLLING_RIGHT_RIGHT;
-				field[c] = ELEMENT_ZONK_ROLLING_RIGHT_LEFT;
-			} else if (field[c.left()].is_space() && field[below.left()].is_space()) {
-				field[below.left()] = ELEMENT_RESERVED;
-				field[c.left()] = ELEMENT_ZONK_ROLLING_LEFT_LEFT;
-				field[c] = ELEMENT_ZONK_ROLLING_LEFT_RIGHT;
-			}
-		}
-	};
-
-	elements[ELEMENT_ZONK_FALLING_DOWN_TOP] = [](const coordinate c) {
-		/* It fell out */
-		if (field[c].next_frame())
-			field[c] = ELEMENT_SPACE;
-	};
-
-	elements[ELEMENT_ZONK_FALLING_DOWN_BOTTOM] = [](const coordinate c) {
-		/* It fell down */
-		if (field[c].next_frame())
-			field[c] = ELEMENT_ZONK;
-	};
+	register const void *r0 asm ("r0") = src;
+	register void *r1 asm ("r1") = dst;
 
-	elements[ELEMENT_ZONK_ROLLING_LEFT_LEFT] = [](const coordinate c) {
-		if (field[c].next_frame())
-			field[c] = ELEMENT_ZONK;
-	};
-
-	elements[ELEMENT_ZONK_ROLLING_LEFT_RIGHT] = [](const coordinate c) {
-		if (field[c].next_frame())
-			field[c] = ELEMENT_SPACE;
-	};
+#ifndef __thumb__
+	asm volatile ("swi #0x120000"
+		: "+r" (r0), "+r" (r1)
+		:
+		: "memory", "r2", "r3");
+#else
+	asm volatile ("swi #0x12"
+		: "+r" (r0), "+r" (r1)
+		:
+		: "memory", "r2", "r3");
+#endif
+}
 
-	elements[ELEMENT_ZONK_ROLLING_RIGHT_RIGHT] = [](const coordinate c) {
-		if (field[c].next_frame())
-			field[c] = ELEMENT_ZONK;
-	};
+int main(void)
+{
+	/* Measure the boot time with timers 2 and 3 (cascaded) */
+	*(volatile uint16_t *) 0x04000108 = 0;
+	*(volatile uint16_t *) 0x0400010c = 0;
+	*(volatile uint16_t *) 0x0400010e = (1 << 2) | (1 << 7);
+	*(volatile uint16_t *) 0x0400010a = (1 << 7);
 
-	elements[ELEMENT_ZONK_ROLLING_RIGHT_LEFT] = [](const coordinate c) {
-		if (field[c].next_frame())
-			field[c] = ELEMENT_SPACE;
-	};
+	init_elements();
+	init_tiles();
 
 	/* LCD off */
 	*(volatile uint16_t *) 0x04000000 = (1 << 7);
 
 	/* Palettes */
-	for (unsigned int i = 0; i < sizeof(palettes) / sizeof(*palettes); ++i)
-		*((uint16_t *) 0x05000000 + i) = palettes[i];
+	dma_copy16((void *) 0x05000000, palettes, palettes_size / 2);
 
 	/* Sprite palettes */
-	for (unsigned int i = 0; i < sizeof(palettes) / sizeof(*palettes); ++i)
-		*((uint16_t *) 0x05000200 + i) = palettes[i];
+	dma_copy16((void *) 0x05000200, palettes, palettes_size / 2);
 
 	/* Tiles */
-	for (unsigned int i = 0; i < sizeof(fixed) / sizeof(*fixed); ++i)
-		*((uint32_t *) 0x06000000 + i) = fixed[i];
+	lz77_decompress_vram(fixed, (void *) 0x06000000);
 
 	/* Sprites */
-	for (unsigned int i = 0; i < sizeof(moving) / sizeof(*moving); ++i)
-		*((uint32_t *) 0x06010000 + i) = moving[i];
+	lz77_decompress_vram(moving, (void *) 0x06010000);
 
-	/* BG0 control */
-	*(volatile uint16_t *) 0x04000008 = (16 << 8);
+	/* BG0 control (64x32 tiles) */
+	*(volatile uint16_t *) 0x04000008 = (16 << 8) | (1 << 14);
 
 	/* Disable unused sprites */
-	for (unsigned int i = 0; i < 128; ++i)
-		*((volatile uint16_t *) 0x07000000 + 4 * i) = (1 << 9);
+	init_sprites();
+	commit_sprites();
 
 	/* Set BG mode */
 	*(volatile uint16_t *) 0x04000000 = (1 << 6) | (1 << 8) | (1 << 12);
+	init_overlay();
+
+	/* Hold Start at boot to replay the recording in SRAM; otherwise we
+	 * make a new one. */
+	if (~*(volatile uint16_t *) 0x04000130 & (1 << 3))
+		load_recording();
+	else
+		recording.magic = 0;
+
+	if (start_replay()) {
+		load_level(game->current_level = recording.level);
+	} else {
+		load_level(game->current_level = 0);
+		start_recording(game->current_level);
+	}
 
-	load_level(current_level = 0);
 	draw();
+	draw_sprites();
+	commit_sprites();
+
+	*(volatile uint16_t *) 0x0400010a = 0;
+	*(volatile uint16_t *) 0x0400010e = 0;
+	boot_cycles = *(volatile uint16_t *) 0x04000108
+		| (uint32_t) *(volatile uint16_t *) 0x0400010c << 16;
+
+	profile_init();
 
 	/* Set up interrupt handler */
 	*(volatile void **) 0x03007ffc = (void *) &irq;
@@ -586,6 +712,49 @@ int main(void)
 	/* Master interrupt enable */
 	*(volatile uint16_t *) 0x04000208 = 1;
 
-	while (true)
-		vblank_wait();
+	while (true) {
+		/* Wait for the next tick, unless we are behind */
+		while (ticks_done == ticks)
+			vblank_wait();
+
+		/* The V-blank IRQ must not draw a frame while we change the
+		 * game field and the shadow OAM. If it hasn't drawn the last
+		 * one yet, that frame is skipped. */
+		*(volatile uint16_t *) 0x04000208 = 0;
+		if (frame_ready)
+			++nr_skipped_frames;
+		frame_ready = false;
+		*(volatile uint16_t *) 0x04000208 = 1;
+
+		/* Run the game for every tick since the last time around */
+		uint32_t start = profile_clock();
+		unsigned int n = 0;
+
+		while (ticks_done != ticks && n < MAX_SKIPPED_FRAMES + 1) {
+			/* Update game field, Murphy and deal with keypad
+			 * changes */
+			update(input(~*(volatile uint16_t *) 0x04000130 & 0x3ff));
+
+			if (input_mode == INPUT_RECORDING)
+				save_recording();
+
+			++ticks_done;
+			++n;
+		}
+
+		if (n > 1)
+			nr_skipped_frames += n - 1;
+
+		/* The sprites are only copied to OAM at the next V-blank, so
+		 * we can fill in the shadow OAM outside the V-blank period. */
+		uint32_t sprites_start = profile_clock();
+		draw_sprites();
+		frame_ready = true;
+
+		uint32_t end = profile_clock();
+		profile_add(PROFILE_DRAW, commit_time + end - sprites_start);
+		profile_add(PROFILE_FRAME, commit_time + end - start);
+
+		draw_overlay();
+	}
 }
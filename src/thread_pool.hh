@@ -0,0 +1,181 @@
+#ifndef THREAD_POOL_HH
+#define THREAD_POOL_HH
+
+/* A fork-join pool of threads for the host tools; the GBA has only the
+ * one CPU, so none of this is used there. run(n, fn) calls fn(0) to
+ * fn(n - 1) on the threads of the pool (the calling thread being one of
+ * them) and returns once they are all done.
+ *
+ * Each thread starts out with its own share of the indices, which it
+ * works through in order. A thread that runs out steals the last half of
+ * what another one has left, so an uneven workload is still spread out
+ * over all of them, while the same thread tends to get the same indices
+ * from one run() to the next (see strips.hh). */
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <stdint.h>
+
+class thread_pool {
+public:
+	explicit thread_pool(unsigned int nr_threads):
+		queues(nr_threads ? nr_threads : 1),
+		fn(0),
+		generation(0),
+		nr_busy(0),
+		stopping(false)
+	{
+		for (unsigned int i = 1; i < nr_threads; ++i)
+			threads.push_back(std::thread(&thread_pool::worker, this, i));
+	}
+
+	~thread_pool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+
+		start.notify_all();
+		for (unsigned int i = 0; i < threads.size(); ++i)
+			threads[i].join();
+	}
+
+	unsigned int size() const
+	{
+		return threads.size() + 1;
+	}
+
+	void run(unsigned int n, const std::function<void (unsigned int)> &f)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			fn = &f;
+			for (unsigned int i = 0; i < queues.size(); ++i) {
+				queues[i].next = (uint64_t) n * i / queues.size();
+				queues[i].end = (uint64_t) n * (i + 1) / queues.size();
+			}
+
+			nr_busy = threads.size();
+			++generation;
+		}
+
+		start.notify_all();
+		work(0);
+
+		std::unique_lock<std::mutex> lock(mutex);
+		while (nr_busy)
+			done.wait(lock);
+
+		fn = 0;
+	}
+
+private:
+	/* The indices from next to end - 1 are left for a thread to do */
+	struct queue {
+		std::mutex mutex;
+		unsigned int next;
+		unsigned int end;
+	};
+
+	std::vector<std::thread> threads;
+	std::vector<queue> queues;
+
+	std::mutex mutex;
+	std::condition_variable start;
+	std::condition_variable done;
+
+	/* The function of the current run(); this only changes while all
+	 * threads but the calling one are waiting for the next generation */
+	const std::function<void (unsigned int)> *fn;
+
+	unsigned int generation;
+	unsigned int nr_busy;
+	bool stopping;
+
+	bool pop(unsigned int self, unsigned int &i)
+	{
+		queue &q = queues[self];
+		std::lock_guard<std::mutex> lock(q.mutex);
+
+		if (q.next == q.end)
+			return false;
+
+		i = q.next++;
+		return true;
+	}
+
+	/* Move the last half of what another thread has left to our own
+	 * queue. Returns false if there was nothing left anywhere. */
+	bool steal(unsigned int self)
+	{
+		for (unsigned int i = 1; i < queues.size(); ++i) {
+			queue &victim = queues[(self + i) % queues.size()];
+			unsigned int first;
+			unsigned int end;
+
+			{
+				std::lock_guard<std::mutex> lock(victim.mutex);
+				if (victim.next == victim.end)
+					continue;
+
+				end = victim.end;
+				first = end - (end - victim.next + 1) / 2;
+				victim.end = first;
+			}
+
+			queue &q = queues[self];
+			std::lock_guard<std::mutex> lock(q.mutex);
+			q.next = first;
+			q.end = end;
+			return true;
+		}
+
+		return false;
+	}
+
+	void work(unsigned int self)
+	{
+		for (;;) {
+			unsigned int i;
+
+			if (pop(self, i))
+				(*fn)(i);
+			else if (!steal(self))
+				break;
+		}
+	}
+
+	void worker(unsigned int self)
+	{
+		unsigned int seen = 0;
+
+		for (;;) {
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				while (!stopping && generation == seen)
+					start.wait(lock);
+
+				if (stopping)
+					return;
+
+				seen = generation;
+			}
+
+			work(self);
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				--nr_busy;
+			}
+
+			done.notify_one();
+		}
+	}
+};
+
+#endif